@@ -0,0 +1,90 @@
+import numpy as np
+from ngsolve import *
+
+from sensitivity import element_integrals
+
+
+def element_centroids(mesh: Mesh) -> np.ndarray:
+    """Centroids of the mesh elements as a (ne, dim) array, from element-wise integrals"""
+    volumes = element_integrals(mesh, CoefficientFunction(1.0))
+    coordinates = [x, y, z][: mesh.dim]
+    return np.stack([element_integrals(mesh, c) / volumes for c in coordinates], axis=1)
+
+
+def transfer_element_values(values: np.ndarray, source: Mesh, target: Mesh) -> np.ndarray:
+    """Transfers piecewise constant element values from the source mesh to the target mesh.
+
+    Each target element takes the value of the source element containing its centroid. The
+    centroids are located and evaluated in a single vectorized call, so this also works between
+    unrelated meshes (e.g. after coarsening), not only between a mesh and its refinement.
+    """
+    gf = GridFunction(L2(source, order=0))
+    gf.vec.FV().NumPy()[:] = values
+    centroids = element_centroids(target)
+    points = source(*[centroids[:, i] for i in range(target.dim)])
+    return np.array(gf(points)).ravel()
+
+
+def zz_error_indicator(mesh: Mesh, flux: CoefficientFunction) -> np.ndarray:
+    """Zienkiewicz-Zhu error indicator of a discontinuous flux (e.g. the stress) per element.
+
+    The flux is recovered as a continuous order 1 field by Set (element-wise projection and
+    averaging at the shared DOFs), and the indicator of an element is the L2 norm of the
+    difference between the flux and its recovery over the element.
+    """
+    flux = flux.Reshape((flux.dim,))
+    recovered = GridFunction(VectorValued(H1(mesh, order=1), flux.dim))
+    recovered.Set(flux)
+    difference = flux - recovered
+    return np.sqrt(np.maximum(element_integrals(mesh, InnerProduct(difference, difference)), 0.0))
+
+
+class AdaptiveMesh:
+    """Locally refined meshes of a fixed geometry, rebuilt from the coarse mesh at every adaptation.
+
+    Every adaptation generates the coarse mesh again and bisects the marked simplices at most
+    `levels` times, marking them from fields given on the previous mesh. Regions that were refined
+    before but are no longer marked (e.g. material that became void) are therefore coarsened back
+    to the coarse mesh size, which Refine() alone cannot do.
+    """
+
+    def __init__(self, geometry, maxh: float, levels: int):
+        self.geometry = geometry
+        self.maxh = maxh
+        self.levels = levels
+
+    def coarse_mesh(self) -> Mesh:
+        return Mesh(self.geometry.GenerateMesh(maxh=self.maxh))
+
+    def adapt(
+        self,
+        source: Mesh,
+        density: np.ndarray,
+        error: np.ndarray,
+        interface: tuple = (0.05, 0.95),
+        error_fraction: float = 0.1,
+    ) -> Mesh:
+        """Mesh refined near the density interface and where the estimated error is large.
+
+        density and error are element values on the source mesh. An element of the new mesh is
+        refined if the density at its centroid is intermediate (strictly inside interface), or if
+        the error it would carry, estimated from the source error density, exceeds error_fraction
+        times the largest source element error. Fully void and fully solid regions with a small
+        error keep the coarse mesh size.
+        """
+        # Squared error per unit volume, so that it can be estimated on elements of another size
+        error_density = error**2 / element_integrals(source, CoefficientFunction(1.0))
+        threshold = error_fraction * np.max(error**2)
+
+        mesh = self.coarse_mesh()
+        for _ in range(self.levels):
+            volumes = element_integrals(mesh, CoefficientFunction(1.0))
+            element_density = transfer_element_values(density, source, mesh)
+            element_error = transfer_element_values(error_density, source, mesh) * volumes
+            marked = (element_density > interface[0]) & (element_density < interface[1])
+            marked |= element_error > threshold
+            if not np.any(marked):
+                break
+            mesh.SetRefinementFlags(marked.tolist())
+            mesh.Refine()
+        return mesh
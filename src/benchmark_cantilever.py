@@ -0,0 +1,177 @@
+import argparse
+import concurrent.futures
+import json
+import resource
+import time
+
+import numpy as np
+from ngsolve import *
+
+import linear_elasticity_2d
+import linear_elasticity_3d
+from probe import RegionProbe
+from solver import DIRECT_SOLVERS, ITERATIVE_SOLVERS, PRECONDITIONERS, LinearSolver
+
+
+def run_case(
+    dim: int, divisions: int, order: int, solver: str, preconditioner: str, condense: bool
+) -> dict:
+    """Solves the cantilever verification problem once and measures each phase.
+
+    Runs in its own process, so that the peak RSS of the process is that of this case only.
+    """
+    # NOTE: All values in standard units: m, N, Pa
+    length = 0.2
+    height = 0.02
+    width = 0.03
+    force = -100.0
+    E = 70e9  # Young's modulus
+    nu = 0.35  # Poisson's ratio
+
+    result = {
+        "dim": dim,
+        "divisions": divisions,
+        "order": order,
+        "solver": solver,
+        "preconditioner": preconditioner if solver in ITERATIVE_SOLVERS else None,
+        "condense": condense,
+    }
+
+    start = time.perf_counter()
+    if dim == 2:
+        script = linear_elasticity_2d
+        mesh = script.create_beam_mesh(length=length, height=height, maxh=height / divisions)
+        traction = (0, force / (width * height))
+        analytical_deflection = script.analytical_beam_deflection(
+            height=height, length=length, E=E, force=force / width
+        )
+    else:
+        script = linear_elasticity_3d
+        mesh = script.create_beam_mesh(
+            length=length, height=height, width=width, maxh=height / divisions
+        )
+        traction = (0, force / (width * height), 0)
+        analytical_deflection = script.analytical_beam_deflection(
+            width=width, height=height, length=length, E=E, force=force
+        )
+    result["mesh_time"] = time.perf_counter() - start
+
+    lam = E * nu / ((1.0 + nu) * (1.0 - 2.0 * nu))
+    mu = E / (2.0 * (1.0 + nu))
+
+    fes = VectorH1(mesh, order=order, dirichlet="fix")
+    u, v = fes.TnT()
+    gfu = GridFunction(fes)
+    result["ne"] = mesh.ne
+    result["ndof"] = fes.ndof
+    freedofs = fes.FreeDofs(coupling=condense)
+    # Size of the global system, i.e. without the condensed interior DOFs
+    result["global_dofs"] = freedofs.NumSet()
+
+    a = BilinearForm(
+        InnerProduct(script.stress(script.strain(u), mu=mu, lam=lam), script.strain(v)) * dx,
+        condense=condense,
+    )
+    linear_solver = LinearSolver(
+        a, freedofs, solver=solver, preconditioner=preconditioner, condense=condense
+    )
+    f = LinearForm(CoefficientFunction(traction) * v * ds("force"))
+
+    try:
+        # Includes the setup of the registered preconditioners (bddc, h1amg, multigrid)
+        start = time.perf_counter()
+        a.Assemble()
+        f.Assemble()
+        result["assembly_time"] = time.perf_counter() - start
+
+        # The CGSolver setup is negligible, for direct solvers this is the factorization
+        start = time.perf_counter()
+        linear_solver.update()
+        result["factorization_time"] = time.perf_counter() - start
+
+        start = time.perf_counter()
+        linear_solver.solve(f.vec, gfu.vec)
+        result["solve_time"] = time.perf_counter() - start
+        result["iterations"] = linear_solver.iterations
+    except Exception as e:
+        # E.g. pardiso not available in this NGSolve build
+        result["error"] = str(e)
+        return result
+
+    numerical_deflection = np.mean(RegionProbe(mesh, "force")(gfu)[:, 1])
+    result["deflection"] = numerical_deflection
+    result["analytical_deflection"] = analytical_deflection
+    result["relative_error"] = abs(numerical_deflection / analytical_deflection - 1.0)
+    # ru_maxrss is in kilobytes on Linux
+    result["peak_rss_mb"] = resource.getrusage(resource.RUSAGE_SELF).ru_maxrss / 1024.0
+    return result
+
+
+def parse_args() -> argparse.Namespace:
+    parser = argparse.ArgumentParser(description="Cantilever solve benchmark")
+    parser.add_argument("--dims", type=int, nargs="+", choices=[2, 3], default=[2, 3])
+    parser.add_argument(
+        "--divisions",
+        type=int,
+        nargs="+",
+        default=[2, 4, 8],
+        help="mesh sizes, as maxh = height / divisions",
+    )
+    parser.add_argument("--orders", type=int, nargs="+", default=[1, 2, 3])
+    parser.add_argument(
+        "--solvers",
+        nargs="+",
+        choices=DIRECT_SOLVERS + ITERATIVE_SOLVERS,
+        default=["sparsecholesky", "pardiso", "umfpack", "cg"],
+    )
+    parser.add_argument("--preconditioner", choices=PRECONDITIONERS, default="bddc")
+    parser.add_argument(
+        "--condense",
+        choices=["off", "on", "both"],
+        default="off",
+        help="static condensation of the interior DOFs, both compares the two",
+    )
+    parser.add_argument("--report", default="benchmark_cantilever.json", help="JSON report")
+    return parser.parse_args()
+
+
+def main() -> None:
+    args = parse_args()
+
+    condense_modes = {"off": [False], "on": [True], "both": [False, True]}[args.condense]
+    cases = [
+        (dim, divisions, order, solver, args.preconditioner, condense)
+        for dim in args.dims
+        for divisions in args.divisions
+        for order in args.orders
+        for solver in args.solvers
+        for condense in condense_modes
+    ]
+
+    print(
+        f"{'dim':>3} {'div':>4} {'order':>5} {'solver':>14} {'cond.':>5} {'ndof':>9} "
+        f"{'global':>9} {'assembly':>9} {'factor':>9} {'solve':>9} {'RSS [MB]':>9} {'error':>9}"
+    )
+    results = []
+    for case in cases:
+        # A fresh process per case, so that the peak RSS is not that of the largest case so far
+        with concurrent.futures.ProcessPoolExecutor(max_workers=1) as executor:
+            result = executor.submit(run_case, *case).result()
+        results.append(result)
+        if "error" in result:
+            print(f"{case[0]:>3} {case[1]:>4} {case[2]:>5} {case[3]:>14} {result['error']}")
+            continue
+        print(
+            f"{result['dim']:>3} {result['divisions']:>4} {result['order']:>5} "
+            f"{result['solver']:>14} {'yes' if result['condense'] else 'no':>5} "
+            f"{result['ndof']:>9} {result['global_dofs']:>9} {result['assembly_time']:>9.4f} "
+            f"{result['factorization_time']:>9.4f} {result['solve_time']:>9.4f} "
+            f"{result['peak_rss_mb']:>9.1f} {result['relative_error']:>9.2e}"
+        )
+
+    with open(args.report, "w") as file:
+        json.dump(results, file, indent=2)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,26 @@
+import time
+
+import ngsolve
+
+from mesh import create_quad_mesh
+
+
+def main() -> None:
+    grid_sizes = [(100, 50), (200, 100), (400, 200), (1000, 500), (2000, 1000)]
+
+    print(f"{'nx':>6} {'ny':>6} {'elements':>10} {'build [s]':>10} {'ngsolve [s]':>12}")
+    for nx, ny in grid_sizes:
+        start = time.perf_counter()
+        mesh = create_quad_mesh(size_x=2.0, size_y=1.0, nx=nx, ny=ny)
+        build_time = time.perf_counter() - start
+
+        # Conversion to an NGSolve mesh builds the topology, part of the startup cost as well
+        start = time.perf_counter()
+        mesh = ngsolve.Mesh(mesh)
+        ngsolve_time = time.perf_counter() - start
+
+        print(f"{nx:>6} {ny:>6} {mesh.ne:>10} {build_time:>10.4f} {ngsolve_time:>12.4f}")
+
+
+if __name__ == "__main__":
+    main()
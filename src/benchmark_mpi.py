@@ -0,0 +1,170 @@
+import argparse
+import json
+import os
+import subprocess
+import sys
+
+
+def parse_args() -> argparse.Namespace:
+    parser = argparse.ArgumentParser(
+        description="Strong scaling of the distributed 3D cantilever solve over MPI ranks"
+    )
+    parser.add_argument(
+        "--ranks",
+        type=int,
+        nargs="+",
+        default=[2**i for i in range(os.cpu_count().bit_length()) if 2**i <= os.cpu_count()],
+        help="numbers of ranks to run, powers of two up to the number of cores by default",
+    )
+    parser.add_argument("--divisions", type=int, default=8, help="maxh = height / divisions")
+    parser.add_argument("--order", type=int, default=2)
+    parser.add_argument(
+        "--preconditioner", choices=["bddc", "local"], default="bddc", help="preconditioner of cg"
+    )
+    parser.add_argument("--repeat", type=int, default=3, help="best of REPEAT runs per count")
+    parser.add_argument("--mpirun", default="mpirun", help="MPI launcher")
+    parser.add_argument(
+        "--worker",
+        action="store_true",
+        help="run the measurement itself, on the ranks started by the launcher (internal)",
+    )
+    return parser.parse_args()
+
+
+def worker(args: argparse.Namespace) -> None:
+    """Distributes, assembles and solves the cantilever on the ranks of MPI_COMM_WORLD.
+
+    The ranks are synchronized before and after each phase, so that the time of a phase is that
+    of its slowest rank. Rank 0 prints the result as a single JSON line. No TaskManager is started,
+    each rank runs a single thread.
+    """
+    # Imported here, so that the launching process neither initializes MPI nor loads NGSolve
+    from mpi4py import MPI
+    from ngsolve import (
+        BilinearForm,
+        CoefficientFunction,
+        GridFunction,
+        InnerProduct,
+        Integrate,
+        LinearForm,
+        VectorH1,
+        ds,
+        dx,
+    )
+
+    import linear_elasticity_3d
+    from parallel import distribute_mesh
+    from solver import LinearSolver
+
+    comm = MPI.COMM_WORLD
+
+    # NOTE: All values in standard units: m, N, Pa
+    length = 0.2
+    height = 0.02
+    width = 0.03
+    force = -100.0
+    E = 70e9  # Young's modulus
+    nu = 0.35  # Poisson's ratio
+
+    def timed(function):
+        comm.Barrier()
+        start = MPI.Wtime()
+        result = function()
+        comm.Barrier()
+        return MPI.Wtime() - start, result
+
+    geo = linear_elasticity_3d.create_beam_geometry(length=length, height=height, width=width)
+    best = {"mesh": float("inf"), "assembly": float("inf"), "solve": float("inf")}
+    for _ in range(args.repeat):
+        # Generation on rank 0 and partitioning, measured together
+        elapsed, mesh = timed(
+            lambda: distribute_mesh(comm, lambda: geo.GenerateMesh(maxh=height / args.divisions))
+        )
+        best["mesh"] = min(best["mesh"], elapsed)
+
+        lam = E * nu / ((1.0 + nu) * (1.0 - 2.0 * nu))
+        mu = E / (2.0 * (1.0 + nu))
+        stress = linear_elasticity_3d.stress
+        strain = linear_elasticity_3d.strain
+        fes = VectorH1(mesh, order=args.order, dirichlet="fix")
+        u, v = fes.TnT()
+        gfu = GridFunction(fes)
+        a = BilinearForm(InnerProduct(stress(strain(u), mu=mu, lam=lam), strain(v)) * dx)
+        f = LinearForm(CoefficientFunction((0, force / (width * height), 0)) * v * ds("force"))
+        solver = LinearSolver(
+            a, fes.FreeDofs(), solver="cg", preconditioner=args.preconditioner, tol=1e-8
+        )
+
+        # BDDC builds its local factorizations and coarse problem during the assembly, so the
+        # preconditioner setup is measured with it
+        elapsed, _ = timed(lambda: (a.Assemble(), f.Assemble(), solver.update()))
+        best["assembly"] = min(best["assembly"], elapsed)
+        elapsed, _ = timed(lambda: solver.solve(f.vec, gfu.vec))
+        best["solve"] = min(best["solve"], elapsed)
+
+    tip_size = Integrate(CoefficientFunction(1.0) * ds("force"), mesh)
+    deflection = Integrate(gfu[1] * ds("force"), mesh) / tip_size
+    ne = comm.allreduce(mesh.ne, op=MPI.SUM)
+    # Rank 0 may only distribute the mesh and hold no elements, so it does not count as a worker
+    working_ranks = comm.allreduce(int(mesh.ne > 0), op=MPI.SUM)
+    if comm.rank == 0:
+        result = {
+            "ranks": comm.size,
+            "working_ranks": working_ranks,
+            "ne": ne,
+            "ndof": fes.ndofglobal,
+            "iterations": solver.iterations,
+            "deflection": deflection,
+            **best,
+        }
+        print(json.dumps(result), flush=True)
+
+
+def main() -> None:
+    args = parse_args()
+    if args.worker:
+        worker(args)
+        return
+
+    reference = None
+    for num_ranks in args.ranks:
+        command = [
+            args.mpirun,
+            "-np",
+            str(num_ranks),
+            sys.executable,
+            os.path.abspath(__file__),
+            "--worker",
+            f"--divisions={args.divisions}",
+            f"--order={args.order}",
+            f"--preconditioner={args.preconditioner}",
+            f"--repeat={args.repeat}",
+        ]
+        # One thread per rank, also in BLAS, so that only the distribution is measured
+        env = dict(os.environ, OMP_NUM_THREADS="1")
+        output = subprocess.run(command, env=env, capture_output=True, text=True, check=True)
+        result = json.loads(output.stdout.strip().splitlines()[-1])
+
+        # Speedup and parallel efficiency of assembly and solve relative to the first rank count,
+        # the mesh generation being sequential. The efficiency is per rank holding elements,
+        # since a rank which only distributes the mesh does no work in these phases.
+        total = result["assembly"] + result["solve"]
+        working_ranks = result["working_ranks"]
+        if reference is None:
+            reference = (total, working_ranks)
+            print(f"Elements: {result['ne']}, DOFs: {result['ndof']}")
+            print(
+                f"{'ranks':>5} {'work.':>5} {'mesh':>9} {'assembly':>9} {'solve':>9} "
+                f"{'cg it.':>6} {'speedup':>8} {'eff.':>6}"
+            )
+        speedup = reference[0] / total
+        efficiency = speedup * reference[1] / working_ranks
+        print(
+            f"{num_ranks:>5} {working_ranks:>5} {result['mesh']:>9.4f} "
+            f"{result['assembly']:>9.4f} {result['solve']:>9.4f} {result['iterations']:>6} "
+            f"{speedup:>8.2f} {efficiency:>6.2f}"
+        )
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,87 @@
+import argparse
+import os
+import time
+
+from ngsolve import *
+
+import linear_elasticity_3d
+from solver import LinearSolver
+
+
+def parse_args() -> argparse.Namespace:
+    parser = argparse.ArgumentParser(description="Thread scaling of the 3D cantilever solve")
+    parser.add_argument(
+        "--threads",
+        type=int,
+        nargs="+",
+        default=[2**i for i in range(os.cpu_count().bit_length()) if 2**i <= os.cpu_count()],
+        help="thread counts to run, powers of two up to the number of cores by default",
+    )
+    parser.add_argument("--divisions", type=int, default=8, help="maxh = height / divisions")
+    parser.add_argument("--order", type=int, default=2)
+    parser.add_argument("--repeat", type=int, default=3, help="best of REPEAT runs per count")
+    return parser.parse_args()
+
+
+def main() -> None:
+    args = parse_args()
+
+    # NOTE: All values in standard units: m, N, Pa
+    length = 0.2
+    height = 0.02
+    width = 0.03
+    force = -100.0
+    E = 70e9  # Young's modulus
+    nu = 0.35  # Poisson's ratio
+
+    mesh = linear_elasticity_3d.create_beam_mesh(
+        length=length, height=height, width=width, maxh=height / args.divisions
+    )
+    lam = E * nu / ((1.0 + nu) * (1.0 - 2.0 * nu))
+    mu = E / (2.0 * (1.0 + nu))
+    stress = linear_elasticity_3d.stress
+    strain = linear_elasticity_3d.strain
+
+    fes = VectorH1(mesh, order=args.order, dirichlet="fix")
+    u, v = fes.TnT()
+    gfu = GridFunction(fes)
+    a = BilinearForm(InnerProduct(stress(strain(u), mu=mu, lam=lam), strain(v)) * dx)
+    f = LinearForm(CoefficientFunction((0, force / (width * height), 0)) * v * ds("force"))
+    print(f"Elements: {mesh.ne}, DOFs: {fes.ndof}")
+
+    print(f"{'threads':>7} {'assembly':>9} {'factor':>9} {'solve':>9} {'speedup':>8} {'eff.':>6}")
+    reference = None
+    for num_threads in args.threads:
+        SetNumThreads(num_threads)
+        best = {"assembly": float("inf"), "factorization": float("inf"), "solve": float("inf")}
+        with TaskManager():
+            for _ in range(args.repeat):
+                start = time.perf_counter()
+                a.Assemble()
+                f.Assemble()
+                best["assembly"] = min(best["assembly"], time.perf_counter() - start)
+
+                # A new solver every time, so that the full factorization is measured
+                solver = LinearSolver(a, fes.FreeDofs(), solver="sparsecholesky")
+                start = time.perf_counter()
+                solver.update()
+                best["factorization"] = min(best["factorization"], time.perf_counter() - start)
+
+                start = time.perf_counter()
+                solver.solve(f.vec, gfu.vec)
+                best["solve"] = min(best["solve"], time.perf_counter() - start)
+
+        # Speedup and parallel efficiency relative to the first thread count
+        total = sum(best.values())
+        if reference is None:
+            reference = total
+        speedup = reference / total
+        efficiency = speedup * args.threads[0] / num_threads
+        print(
+            f"{num_threads:>7} {best['assembly']:>9.4f} {best['factorization']:>9.4f} "
+            f"{best['solve']:>9.4f} {speedup:>8.2f} {efficiency:>6.2f}"
+        )
+
+
+if __name__ == "__main__":
+    main()
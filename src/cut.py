@@ -0,0 +1,219 @@
+import numpy as np
+from ngsolve import *
+
+from filters import heaviside_derivative, heaviside_projection
+from mesh import create_quad_mesh
+from structured import csr_positions, quad_element_dofs
+
+
+def subcell_shape_functions(subdivisions: int) -> np.ndarray:
+    """Bilinear cell shape functions at the centers of the subdivisions x subdivisions subcells.
+
+    One row per subcell, numbered like the elements of create_quad_mesh, and one column per cell
+    vertex, ordered like the cell DOFs of quad_element_dofs.
+    """
+    s = (np.arange(subdivisions) + 0.5) / subdivisions
+    xi, eta = np.meshgrid(s, s)
+    xi, eta = xi.ravel(), eta.ravel()
+    return np.stack([(1 - xi) * (1 - eta), xi * (1 - eta), (1 - xi) * eta, xi * eta], axis=1)
+
+
+def subcell_matrices(size_x: float, size_y: float, integrand, subdivisions: int) -> np.ndarray:
+    """Element matrices of integrand(u, v) * dx over each subcell of a single quad cell.
+
+    The bilinear functions of the cell are bilinear on every subcell, so they are exactly
+    represented on a subdivided cell mesh: each subcell matrix is assembled there and restricted
+    to the cell DOFs. The subcell matrices sum up to cell_matrix(size_x, size_y, integrand).
+    Returns an array of shape (subdivisions**2, 8, 8).
+    """
+    s = subdivisions
+    mesh = Mesh(create_quad_mesh(size_x=size_x, size_y=size_y, nx=s, ny=s))
+    fes = VectorH1(mesh, order=1)
+    u, v = fes.TnT()
+    indicator = GridFunction(L2(mesh, order=0))
+    a = BilinearForm(indicator * integrand(u, v) * dx)
+
+    # Cell shape functions at the subdivision points, for both (blocked) components
+    xi, eta = np.meshgrid(np.arange(s + 1) / s, np.arange(s + 1) / s)
+    xi, eta = xi.ravel(), eta.ravel()
+    shape = np.stack([(1 - xi) * (1 - eta), xi * (1 - eta), (1 - xi) * eta, xi * eta], axis=1)
+    prolongation = np.kron(np.eye(2), shape)
+
+    matrices = []
+    for subcell in range(s * s):
+        indicator.vec[:] = 0.0
+        indicator.vec[subcell] = 1.0
+        a.Assemble()
+        matrices.append(prolongation.T @ a.mat.ToDense().NumPy() @ prolongation)
+    return np.array(matrices)
+
+
+def ghost_penalty_matrices(size_x: float, size_y: float) -> tuple[np.ndarray, np.ndarray]:
+    """Face ghost penalty matrices of two cells side by side along x, and along y.
+
+    The penalty is h [du/dn] . [dv/dn] over the shared face, for the DOFs of the two cells ordered
+    like the points of a 2 x 1 (resp. 1 x 2) create_quad_mesh, components blocked.
+    """
+    matrices = []
+    for patch in [(2 * size_x, size_y, 2, 1), (size_x, 2 * size_y, 1, 2)]:
+        mesh = Mesh(create_quad_mesh(*patch))
+        fes = VectorH1(mesh, order=1, dgjumps=True)
+        u, v = fes.TnT()
+        n = specialcf.normal(2)
+        h = specialcf.mesh_size
+        jump_u = (Grad(u) - Grad(u.Other())) * n
+        jump_v = (Grad(v) - Grad(v.Other())) * n
+        a = BilinearForm(h * InnerProduct(jump_u, jump_v) * dx(skeleton=True)).Assemble()
+        matrices.append(np.array(a.mat.ToDense().NumPy()))
+    return matrices[0], matrices[1]
+
+
+class DensityLevelSet:
+    """Crisp material boundary defined by a level of the filtered density (Andreasen et al.).
+
+    The element densities are averaged to the grid points and interpolated bilinearly, and the
+    material occupies the region where this field exceeds the threshold eta. The material
+    indicator of each subcell is the Heaviside projection of the field at its center, sharp for a
+    large beta and differentiable for the sensitivities. Points and cells are numbered like the
+    points and elements of create_quad_mesh.
+    """
+
+    def __init__(self, nx: int, ny: int, subdivisions: int = 4, void_tolerance: float = 1e-3):
+        self.num_points = (nx + 1) * (ny + 1)
+        # The x component DOFs of quad_element_dofs are the cell vertices
+        self.vertices = quad_element_dofs(nx, ny)[:, :4]
+        self.counts = np.bincount(self.vertices.ravel(), minlength=self.num_points)
+        self.shape_functions = subcell_shape_functions(subdivisions)
+        self.void_tolerance = void_tolerance
+
+    def point_density(self, density: np.ndarray) -> np.ndarray:
+        """Average of the element densities around each point"""
+        sums = np.bincount(
+            self.vertices.ravel(), weights=np.repeat(density, 4), minlength=self.num_points
+        )
+        return sums / self.counts
+
+    def subcell_density(self, density: np.ndarray) -> np.ndarray:
+        return self.point_density(density)[self.vertices] @ self.shape_functions.T
+
+    def indicator(self, density: np.ndarray, beta: float, eta: float) -> np.ndarray:
+        """Material indicator of every subcell, of shape (ne, subdivisions**2)"""
+        return heaviside_projection(self.subcell_density(density), beta=beta, eta=eta)
+
+    def volume(self, density: np.ndarray, beta: float, eta: float) -> float:
+        return np.mean(self.indicator(density, beta=beta, eta=eta))
+
+    def chain(
+        self, gradient: np.ndarray, density: np.ndarray, beta: float, eta: float
+    ) -> np.ndarray:
+        """Chain rule from a gradient with respect to the subcell indicators (ne, subcells) to
+        a gradient with respect to the element densities"""
+        gradient = gradient * heaviside_derivative(
+            self.subcell_density(density), beta=beta, eta=eta
+        )
+        point_gradient = np.bincount(
+            self.vertices.ravel(),
+            weights=(gradient @ self.shape_functions).ravel(),
+            minlength=self.num_points,
+        )
+        return (point_gradient / self.counts)[self.vertices].sum(axis=1)
+
+    def classify(self, indicator: np.ndarray) -> tuple[np.ndarray, np.ndarray]:
+        """Active (not entirely void) and cut (active, not entirely solid) cells"""
+        active = np.max(indicator, axis=1) > self.void_tolerance
+        cut = active & (np.min(indicator, axis=1) < 1.0 - self.void_tolerance)
+        return active, cut
+
+
+class CutAssembler:
+    """Structured assembly of the stiffness matrix restricted to the material side of a boundary.
+
+    Each cell contributes the sum of its subcell matrices weighted by the subcell material
+    indicators, so void cells contribute nothing and cut cells only their material part. The
+    faces of the cut cells with their active neighbours carry a ghost penalty, which bounds the
+    conditioning of the system however small the material part of a cut cell is.
+
+    The matrix must have the sparsity pattern of a VectorH1 space with dgjumps=True, which couples
+    the DOFs of cells sharing a face, needed by the ghost penalty.
+    """
+
+    def __init__(
+        self,
+        mat,
+        nx: int,
+        ny: int,
+        subcell_matrices: np.ndarray,
+        ghost_matrices: tuple[np.ndarray, np.ndarray],
+    ):
+        self.nx = nx
+        self.ny = ny
+        self.subcell_matrices = subcell_matrices.reshape(subcell_matrices.shape[0], -1)
+        self.ghost_matrices = [m.ravel() for m in ghost_matrices]
+        self.element_dofs = quad_element_dofs(nx, ny)
+
+        num_points = (nx + 1) * (ny + 1)
+        # Points of the cell pairs, ordered like ghost_penalty_matrices
+        ix, iy = np.meshgrid(np.arange(nx - 1), np.arange(ny))
+        p0 = (iy * (nx + 1) + ix).ravel()
+        horizontal = np.stack([p0, p0 + 1, p0 + 2, p0 + nx + 1, p0 + nx + 2, p0 + nx + 3], axis=1)
+        ix, iy = np.meshgrid(np.arange(nx), np.arange(ny - 1))
+        p0 = (iy * (nx + 1) + ix).ravel()
+        vertical = np.stack(
+            [p0, p0 + 1, p0 + nx + 1, p0 + nx + 2, p0 + 2 * nx + 2, p0 + 2 * nx + 3], axis=1
+        )
+        self.positions = np.concatenate(
+            [
+                csr_positions(mat, self.element_dofs),
+                csr_positions(mat, np.concatenate([horizontal, horizontal + num_points], axis=1)),
+                csr_positions(mat, np.concatenate([vertical, vertical + num_points], axis=1)),
+            ]
+        )
+        self.values = mat.AsVector().FV().NumPy()
+
+    def ghost_faces(self, active: np.ndarray, cut: np.ndarray) -> tuple[np.ndarray, np.ndarray]:
+        """Faces along x and along y between two active cells, at least one of which is cut"""
+        active = active.reshape(self.ny, self.nx)
+        cut = cut.reshape(self.ny, self.nx)
+        horizontal = active[:, :-1] & active[:, 1:] & (cut[:, :-1] | cut[:, 1:])
+        vertical = active[:-1, :] & active[1:, :] & (cut[:-1, :] | cut[1:, :])
+        return horizontal.ravel(), vertical.ravel()
+
+    def assemble(
+        self,
+        indicator: np.ndarray,
+        stiffness: float,
+        ghost_penalty: float,
+        ghost_faces: tuple,
+        floor_cells: np.ndarray = None,
+        floor: float = 1e-6,
+    ) -> np.ndarray:
+        """Overwrites the matrix with the cut cell stiffness of a material of Young's modulus
+        stiffness and the ghost penalty, scaled by ghost_penalty * stiffness, on the ghost faces.
+
+        The cells of the mask floor_cells (e.g. those with free DOFs) get at least a floor *
+        stiffness fraction of material, so that no free DOF is left without stiffness.
+
+        Returns the stiffness scale of each cell, i.e. the Young's modulus times the (floored)
+        material fraction, e.g. for the coarse levels of a multigrid preconditioner.
+        """
+        if floor_cells is not None:
+            indicator = np.maximum(indicator, floor * floor_cells[:, None])
+        weights = [
+            (stiffness * indicator) @ self.subcell_matrices,
+            np.outer(ghost_penalty * stiffness * ghost_faces[0], self.ghost_matrices[0]),
+            np.outer(ghost_penalty * stiffness * ghost_faces[1], self.ghost_matrices[1]),
+        ]
+        self.values[:] = np.bincount(
+            self.positions,
+            weights=np.concatenate([w.ravel() for w in weights]),
+            minlength=len(self.values),
+        )
+        return stiffness * np.mean(indicator, axis=1)
+
+    def subcell_energy(self, vec, other=None) -> np.ndarray:
+        """Unscaled subcell energies u_e^T K_q u_e of the vector vec, or mutual energies
+        w_e^T K_q u_e with the vector other, of shape (ne, subcells)"""
+        ue = vec.FV().NumPy()[self.element_dofs]
+        we = ue if other is None else other.FV().NumPy()[self.element_dofs]
+        matrices = self.subcell_matrices.reshape(-1, ue.shape[1], ue.shape[1])
+        return np.einsum("ei,qij,ej->eq", we, matrices, ue)
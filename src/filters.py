@@ -0,0 +1,110 @@
+import numpy as np
+from ngsolve import *
+from ngsolve.krylovspace import CGSolver
+
+
+class GridFilter:
+    """Linear density filter with a cone kernel on a regular nx by ny grid of elements.
+
+    Element values are ordered like the elements of create_quad_mesh, i.e. row by row. The filter
+    H x / Hs with weights max(0, radius - distance) is applied as a stencil convolution with
+    precomputed offsets and weights, so its cost is linear in the number of elements (times the
+    size of the stencil) and no O(n^2) neighbor search is needed.
+    """
+
+    def __init__(self, nx: int, ny: int, size_x: float, size_y: float, radius: float):
+        self.nx = nx
+        self.ny = ny
+        hx = size_x / nx
+        hy = size_y / ny
+        kx = int(np.ceil(radius / hx)) - 1
+        ky = int(np.ceil(radius / hy)) - 1
+        di, dj = np.meshgrid(np.arange(-ky, ky + 1), np.arange(-kx, kx + 1), indexing="ij")
+        weights = radius - np.sqrt((di * hy) ** 2 + (dj * hx) ** 2)
+        mask = weights > 0.0
+        self.offsets = list(zip(di[mask], dj[mask]))
+        self.weights = weights[mask]
+        self.weight_sums = self.convolve(np.ones(nx * ny))
+
+    def convolve(self, values: np.ndarray) -> np.ndarray:
+        """Unnormalized weighted sum H values over the neighbors of each element"""
+        field = values.reshape(self.ny, self.nx)
+        result = np.zeros_like(field)
+        for (di, dj), w in zip(self.offsets, self.weights):
+            result[
+                max(0, -di) : self.ny - max(0, di), max(0, -dj) : self.nx - max(0, dj)
+            ] += w * field[max(0, di) : self.ny + min(0, di), max(0, dj) : self.nx + min(0, dj)]
+        return result.ravel()
+
+    def apply(self, x: np.ndarray) -> np.ndarray:
+        return self.convolve(x) / self.weight_sums
+
+    def apply_transpose(self, gradient: np.ndarray) -> np.ndarray:
+        """Chain rule of apply(), the kernel being symmetric"""
+        return self.convolve(gradient / self.weight_sums)
+
+    def filter_sensitivity(self, x: np.ndarray, dc: np.ndarray) -> np.ndarray:
+        """Heuristic sensitivity filter of Sigmund (1997)"""
+        return self.convolve(x * dc) / (self.weight_sums * np.maximum(1e-3, x))
+
+
+class HelmholtzFilter:
+    """PDE filter for element-wise densities on arbitrary meshes (Lazarov and Sigmund, 2011).
+
+    The filtered density solves -r^2 Laplace(u) + u = x with natural boundary conditions, and is
+    averaged back onto the elements. The scalar H1 system only depends on the mesh and radius, so
+    it is assembled and factorized once; each application is a right-hand side assembly, a pair of
+    triangular solves and an element-wise integration, all linear in the mesh size.
+
+    With B the element-to-node load operator, K the Helmholtz matrix and D the element volumes,
+    apply(x) = D^-1 B^T K^-1 B x. With natural boundary conditions, the constant function is in the
+    space, and testing with it shows that the filter conserves the volume: dv^T apply(x) = dv^T x,
+    so apply_transpose(dv) = dv.
+
+    On a distributed mesh, inverse="cg" solves with Jacobi preconditioned cg instead of a direct
+    factorization. The mass term bounds the condition number by about 1 + (r / h)^2, so a few
+    tens of iterations suffice for the usual radii of a few elements.
+    """
+
+    def __init__(self, mesh: Mesh, radius: float, inverse: str = "sparsecholesky"):
+        self.mesh = mesh
+        # Length scale matching a cone filter of the given radius
+        r = radius / (2.0 * np.sqrt(3.0))
+        fes = H1(mesh, order=1)
+        u, v = fes.TnT()
+        a = BilinearForm(r**2 * grad(u) * grad(v) * dx + u * v * dx).Assemble()
+        if inverse == "cg":
+            pre = a.mat.CreateSmoother(fes.FreeDofs())
+            self.inv = CGSolver(a.mat, pre=pre, tol=1e-10)
+        else:
+            self.inv = a.mat.Inverse(freedofs=fes.FreeDofs(), inverse=inverse)
+        self.source = GridFunction(L2(mesh, order=0))
+        self.f = LinearForm(self.source * v * dx)
+        self.gf = GridFunction(fes)
+        self.volumes = np.array(Integrate(CoefficientFunction(1.0), mesh, element_wise=True))
+
+    def apply(self, x: np.ndarray) -> np.ndarray:
+        self.source.vec.FV().NumPy()[:] = x
+        self.f.Assemble()
+        self.gf.vec.data = self.inv * self.f.vec
+        return np.array(Integrate(self.gf, self.mesh, element_wise=True)) / self.volumes
+
+    def apply_transpose(self, gradient: np.ndarray) -> np.ndarray:
+        """Chain rule of apply(), D^-1 B^T K^-1 B being self-adjoint up to the volume scaling"""
+        return self.volumes * self.apply(gradient / self.volumes)
+
+    def filter_sensitivity(self, x: np.ndarray, dc: np.ndarray) -> np.ndarray:
+        return self.apply(x * dc) / np.maximum(1e-3, x)
+
+
+def heaviside_projection(x: np.ndarray, beta: float, eta: float = 0.5) -> np.ndarray:
+    """Smoothed Heaviside projection with sharpness beta and threshold eta"""
+    return (np.tanh(beta * eta) + np.tanh(beta * (x - eta))) / (
+        np.tanh(beta * eta) + np.tanh(beta * (1.0 - eta))
+    )
+
+
+def heaviside_derivative(x: np.ndarray, beta: float, eta: float = 0.5) -> np.ndarray:
+    return beta * (1.0 - np.tanh(beta * (x - eta)) ** 2) / (
+        np.tanh(beta * eta) + np.tanh(beta * (1.0 - eta))
+    )
@@ -0,0 +1,83 @@
+import os
+import os.path
+
+import numpy as np
+
+# One fixed-size binary record per iteration, appended to history.dat
+HISTORY_DTYPE = np.dtype(
+    [
+        ("iteration", np.int64),
+        ("objective", np.float64),
+        ("volume", np.float64),
+        ("change", np.float64),
+        ("beta", np.float64),
+        ("time", np.float64),
+    ]
+)
+
+
+class History:
+    """Streaming iteration history, density snapshots and checkpoints of an optimization run.
+
+    All the files live in one directory:
+    - history.dat: HISTORY_DTYPE records, appended every iteration
+    - densities.dat: float64 chunks [iteration, density...], appended every snapshot
+    - checkpoint.npz: the state needed to restart, atomically replaced at every checkpoint
+
+    Both .dat files are raw arrays which can be read (or memory-mapped) while the run is going,
+    with read_history() and read_densities(). When restarting, the records written after the last
+    checkpoint are dropped, so that the files stay consistent with the resumed run.
+    """
+
+    def __init__(self, directory: str, num_elements: int, restart: bool = False):
+        self.directory = directory
+        self.num_elements = num_elements
+        os.makedirs(directory, exist_ok=True)
+        self.history_path = os.path.join(directory, "history.dat")
+        self.densities_path = os.path.join(directory, "densities.dat")
+        self.checkpoint_path = os.path.join(directory, "checkpoint.npz")
+        if restart and not os.path.exists(self.checkpoint_path):
+            raise ValueError(f"cannot restart, there is no checkpoint {self.checkpoint_path}")
+        if not restart:
+            for path in [self.history_path, self.densities_path, self.checkpoint_path]:
+                if os.path.exists(path):
+                    os.remove(path)
+
+    def append(self, **metrics) -> None:
+        record = np.zeros(1, dtype=HISTORY_DTYPE)
+        for name, value in metrics.items():
+            record[name] = value
+        with open(self.history_path, "ab") as file:
+            record.tofile(file)
+
+    def snapshot(self, iteration: int, density: np.ndarray) -> None:
+        with open(self.densities_path, "ab") as file:
+            np.concatenate([[iteration], density]).astype(np.float64).tofile(file)
+
+    def save_checkpoint(self, iteration: int, **state) -> None:
+        # Written next to the previous checkpoint, which is only replaced once complete
+        temporary_path = self.checkpoint_path + ".tmp.npz"
+        np.savez(temporary_path, iteration=iteration, **state)
+        os.replace(temporary_path, self.checkpoint_path)
+
+    def load_checkpoint(self) -> dict:
+        with np.load(self.checkpoint_path) as checkpoint:
+            state = {name: checkpoint[name] for name in checkpoint.files}
+        iteration = int(state["iteration"])
+
+        history = self.read_history()
+        history[history["iteration"] <= iteration].tofile(self.history_path)
+        densities = self.read_densities()
+        densities[densities[:, 0] <= iteration].tofile(self.densities_path)
+        return state
+
+    def read_history(self) -> np.ndarray:
+        if not os.path.exists(self.history_path):
+            return np.zeros(0, dtype=HISTORY_DTYPE)
+        return np.fromfile(self.history_path, dtype=HISTORY_DTYPE)
+
+    def read_densities(self) -> np.ndarray:
+        """Density snapshots, one row per snapshot with the iteration in the first column"""
+        if not os.path.exists(self.densities_path):
+            return np.zeros((0, self.num_elements + 1))
+        return np.fromfile(self.densities_path).reshape(-1, self.num_elements + 1)
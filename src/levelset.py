@@ -0,0 +1,199 @@
+import numpy as np
+
+
+def hole_level_set(
+    nx: int, ny: int, size_x: float, size_y: float, holes_x: int, holes_y: int, radius: float
+) -> np.ndarray:
+    """Signed distance to a regular pattern of circular holes, at the create_quad_mesh points.
+
+    Positive in the material, negative in the holes, as a (ny + 1, nx + 1) array.
+    """
+    x, y = np.meshgrid(np.arange(nx + 1) / nx * size_x, np.arange(ny + 1) / ny * size_y)
+    cx, cy = np.meshgrid(
+        (np.arange(holes_x) + 0.5) / holes_x * size_x,
+        (np.arange(holes_y) + 0.5) / holes_y * size_y,
+    )
+    distance = (
+        np.sqrt((x[..., None] - cx.ravel()) ** 2 + (y[..., None] - cy.ravel()) ** 2) - radius
+    )
+    return np.min(distance, axis=-1)
+
+
+class NarrowBandLevelSet:
+    """Level set function on the points of a create_quad_mesh grid, evolved in a narrow band.
+
+    The material occupies phi > 0. Only the points with |phi| < width (the band) are stored with
+    their actual value, the others are clamped to +-width. Evolving and reinitializing the level
+    set, and updating the material fraction of the cells, only visits the band and its direct
+    neighbours, so their cost scales with the length of the interface rather than with the area
+    of the domain. This requires the interface to move by less than a cell per update.
+
+    Points are numbered like the mesh points (iy * (nx + 1) + ix) and cells like the mesh
+    elements (iy * nx + ix).
+    """
+
+    def __init__(
+        self,
+        phi: np.ndarray,
+        size_x: float,
+        size_y: float,
+        band_cells: float = 3.0,
+        subsamples: int = 4,
+    ):
+        self.ny, self.nx = phi.shape[0] - 1, phi.shape[1] - 1
+        self.hx = size_x / self.nx
+        self.hy = size_y / self.ny
+        self.h = min(self.hx, self.hy)
+        self.width = band_cells * max(self.hx, self.hy)
+        self.phi = np.clip(phi, -self.width, self.width).ravel()
+        self.band = np.flatnonzero(np.abs(self.phi) < self.width)
+
+        # Cell-local coordinates of the sample points of the material fraction
+        s = (np.arange(subsamples) + 0.5) / subsamples
+        xi, eta = np.meshgrid(s, s)
+        self.shape_functions = np.stack(
+            [(1 - xi) * (1 - eta), xi * (1 - eta), (1 - xi) * eta, xi * eta], axis=-1
+        ).reshape(-1, 4)
+
+        self.fraction = self.cell_fractions(np.arange(self.nx * self.ny))
+        self.volume = np.mean(self.fraction)
+
+    def dilate(self, points: np.ndarray) -> np.ndarray:
+        """The points and their (up to 8) neighbours"""
+        iy, ix = np.divmod(points, self.nx + 1)
+        offsets = np.arange(-1, 2)
+        jy = np.clip(iy[:, None, None] + offsets[None, :, None], 0, self.ny)
+        jx = np.clip(ix[:, None, None] + offsets[None, None, :], 0, self.nx)
+        return np.unique(jy * (self.nx + 1) + jx)
+
+    def point_cells(self, points: np.ndarray) -> np.ndarray:
+        """The cells having at least one vertex among the points"""
+        iy, ix = np.divmod(points, self.nx + 1)
+        offsets = np.arange(-1, 1)
+        cy = iy[:, None, None] + offsets[None, :, None]
+        cx = ix[:, None, None] + offsets[None, None, :]
+        valid = (cy >= 0) & (cy < self.ny) & (cx >= 0) & (cx < self.nx)
+        return np.unique((cy * self.nx + cx)[valid])
+
+    def cell_values_at_points(self, cell_values: np.ndarray, points: np.ndarray) -> np.ndarray:
+        """Average of cell values over the cells around each point"""
+        iy, ix = np.divmod(points, self.nx + 1)
+        offsets = np.arange(-1, 1)
+        cy = iy[:, None, None] + offsets[None, :, None]
+        cx = ix[:, None, None] + offsets[None, None, :]
+        valid = (cy >= 0) & (cy < self.ny) & (cx >= 0) & (cx < self.nx)
+        cells = np.where(valid, cy * self.nx + cx, 0)
+        values = np.where(valid, cell_values[cells], 0.0)
+        return values.sum(axis=(1, 2)) / valid.sum(axis=(1, 2))
+
+    def cell_fractions(self, cells: np.ndarray) -> np.ndarray:
+        """Material fraction of the cells, sampling the bilinear interpolant of phi"""
+        iy, ix = np.divmod(cells, self.nx)
+        p0 = iy * (self.nx + 1) + ix
+        vertices = np.stack([p0, p0 + 1, p0 + self.nx + 1, p0 + self.nx + 2], axis=1)
+        samples = self.phi[vertices] @ self.shape_functions.T
+        return np.mean(samples > 0.0, axis=1)
+
+    def _gradient_norms(self, points: np.ndarray) -> tuple[np.ndarray, np.ndarray]:
+        """Godunov upwind norms of the gradient of phi at the points, for a front moving along
+        the outward (first) and inward (second) normal of the phi > 0 region"""
+        iy, ix = np.divmod(points, self.nx + 1)
+        row = iy * (self.nx + 1)
+        phi = self.phi[points]
+        # One-sided differences, zero at the domain boundary (homogeneous Neumann)
+        dxm = (phi - self.phi[row + np.maximum(ix - 1, 0)]) / self.hx
+        dxp = (self.phi[row + np.minimum(ix + 1, self.nx)] - phi) / self.hx
+        dym = (phi - self.phi[np.maximum(iy - 1, 0) * (self.nx + 1) + ix]) / self.hy
+        dyp = (self.phi[np.minimum(iy + 1, self.ny) * (self.nx + 1) + ix] - phi) / self.hy
+        grow = np.sqrt(
+            np.minimum(dxm, 0.0) ** 2
+            + np.maximum(dxp, 0.0) ** 2
+            + np.minimum(dym, 0.0) ** 2
+            + np.maximum(dyp, 0.0) ** 2
+        )
+        shrink = np.sqrt(
+            np.maximum(dxm, 0.0) ** 2
+            + np.minimum(dxp, 0.0) ** 2
+            + np.maximum(dym, 0.0) ** 2
+            + np.minimum(dyp, 0.0) ** 2
+        )
+        return grow, shrink
+
+    def _advect(self, points: np.ndarray, velocity: np.ndarray, steps: int, cfl: float) -> None:
+        """Upwind explicit steps of phi_t = velocity |grad phi|, in place on the points.
+
+        A positive velocity moves the interface outwards, i.e. grows the material. The time step
+        is such that the interface moves by at most cfl cells per step.
+        """
+        dt = cfl * self.h / max(np.max(np.abs(velocity)), 1e-30)
+        for _ in range(steps):
+            grow, shrink = self._gradient_norms(points)
+            self.phi[points] += dt * (
+                np.maximum(velocity, 0.0) * grow + np.minimum(velocity, 0.0) * shrink
+            )
+
+    def evolve(
+        self,
+        cell_velocity: np.ndarray,
+        target_volume: float,
+        steps: int = 4,
+        cfl: float = 0.2,
+        bisection_iterations: int = 30,
+    ) -> float:
+        """Moves the interface with the normal velocity cell_velocity - multiplier.
+
+        cell_velocity is typically the shape derivative of the objective per cell (e.g. the strain
+        energy density for the compliance), only read around the band. The Lagrange multiplier of
+        the volume constraint is found by bisection, such that the volume fraction after the update
+        matches target_volume; it is returned.
+        """
+        points = self.dilate(self.band)
+        cells = self.point_cells(points)
+        velocity = self.cell_values_at_points(cell_velocity, points)
+        initial = self.phi[points].copy()
+        initial_fraction = self.fraction[cells]
+        total_cells = self.nx * self.ny
+
+        def update(multiplier: float) -> np.ndarray:
+            self.phi[points] = initial
+            self._advect(points, velocity - multiplier, steps, cfl)
+            return self.cell_fractions(cells)
+
+        low, high = np.min(velocity), np.max(velocity)
+        for _ in range(bisection_iterations):
+            multiplier = 0.5 * (low + high)
+            fraction = update(multiplier)
+            volume = self.volume + np.sum(fraction - initial_fraction) / total_cells
+            # A larger multiplier removes more material
+            if volume > target_volume:
+                low = multiplier
+            else:
+                high = multiplier
+
+        fraction = update(multiplier)
+        self._commit(points, cells, fraction)
+        return multiplier
+
+    def reinitialize(self, iterations: int = None, cfl: float = 0.5) -> None:
+        """Restores phi to a signed distance in the band, solving
+        phi_t + sign(phi0) (|grad phi| - 1) = 0 with upwind steps"""
+        if iterations is None:
+            iterations = int(np.ceil(self.width / (cfl * self.h)))
+        points = self.dilate(self.band)
+        cells = self.point_cells(points)
+        phi0 = self.phi[points].copy()
+        # Smoothed sign, so that the zero contour barely moves
+        sign = phi0 / np.sqrt(phi0**2 + self.h**2)
+        dt = cfl * self.h
+        for _ in range(iterations):
+            grow, shrink = self._gradient_norms(points)
+            # Flow along the normal away from the interface, towards |grad phi| = 1
+            norm = np.where(sign > 0.0, shrink, grow)
+            self.phi[points] -= dt * sign * (norm - 1.0)
+        self._commit(points, cells, self.cell_fractions(cells))
+
+    def _commit(self, points: np.ndarray, cells: np.ndarray, fraction: np.ndarray) -> None:
+        self.phi[points] = np.clip(self.phi[points], -self.width, self.width)
+        self.volume += np.sum(fraction - self.fraction[cells]) / (self.nx * self.ny)
+        self.fraction[cells] = fraction
+        self.band = points[np.abs(self.phi[points]) < self.width]
@@ -1,10 +1,14 @@
-import os.path
-import webbrowser
+import argparse
 
 import numpy as np
 from netgen.geom2d import SplineGeometry
 from ngsolve import *
-from ngsolve.webgui import Draw
+
+from output import VTKWriter, add_output_arguments, draw
+from probe import RegionProbe
+from profiling import Profiler, add_profiling_arguments
+from runtime import add_threading_arguments, run_in_task_manager
+from solver import LinearSolver, add_solver_arguments
 
 
 def analytical_beam_deflection(height: float, length: float, E: float, force: float):
@@ -20,15 +24,7 @@ def strain(displacement):
     return Sym(Grad(displacement))
 
 
-def main() -> None:
-    # NOTE: All values in standard units: m, N, Pa
-    length = 0.2
-    height = 0.02
-    width = 0.03
-    force = -100.0
-    E = 70e9  # Young's modulus
-    nu = 0.35  # Poisson's ratio
-
+def create_beam_mesh(length: float, height: float, maxh: float) -> Mesh:
     geo = SplineGeometry()
     p1 = geo.AppendPoint(0, 0)
     p2 = geo.AppendPoint(length, 0)
@@ -38,42 +34,108 @@ def main() -> None:
     geo.Append(["line", p2, p3], bc="force")
     geo.Append(["line", p3, p4])
     geo.Append(["line", p4, p1], bc="fix")
-    mesh = Mesh(geo.GenerateMesh(maxh=height / 5.0))
+    return Mesh(geo.GenerateMesh(maxh=maxh))
+
+
+def parse_args() -> argparse.Namespace:
+    parser = argparse.ArgumentParser(description="2D cantilever beam")
+    parser.add_argument(
+        "--multi-load",
+        action="store_true",
+        help="solve several tip load cases at once against the same factorization",
+    )
+    add_solver_arguments(parser)
+    add_threading_arguments(parser)
+    add_output_arguments(parser)
+    add_profiling_arguments(parser)
+    return parser.parse_args()
 
-    # Lamé parameters
-    lam = E * nu / ((1.0 + nu) * (1.0 - 2.0 * nu))
-    mu = E / (2.0 * (1.0 + nu))
 
-    fes = VectorH1(mesh, order=2, dirichlet="fix")
-    u = fes.TrialFunction()
-    v = fes.TestFunction()
-    gfu = GridFunction(fes)
+def run(args: argparse.Namespace) -> None:
+    profiler = Profiler.from_args(args)
 
-    a = BilinearForm(InnerProduct(stress(strain(u), mu=mu, lam=lam), strain(v)) * dx)
-    a.Assemble()
+    # NOTE: All values in standard units: m, N, Pa
+    length = 0.2
+    height = 0.02
+    width = 0.03
+    force = -100.0
+    E = 70e9  # Young's modulus
+    nu = 0.35  # Poisson's ratio
+
+    with profiler.phase("mesh"):
+        mesh = create_beam_mesh(length=length, height=height, maxh=height / 5.0)
 
-    f = LinearForm(CoefficientFunction((0, force / (width * height))) * v * ds("force"))
-    f.Assemble()
+    # Lamé parameters
+    lam = E * nu / ((1.0 + nu) * (1.0 - 2.0 * nu))
+    mu = E / (2.0 * (1.0 + nu))
 
-    inv = a.mat.Inverse(freedofs=fes.FreeDofs(), inverse="sparsecholesky")
-    gfu.vec.data = inv * f.vec
+    with profiler.phase("space"):
+        fes = VectorH1(mesh, order=2, dirichlet="fix")
+        u = fes.TrialFunction()
+        v = fes.TestFunction()
+        gfu = GridFunction(fes)
 
-    Draw(gfu, filename="out.html")
-    webbrowser.open("file://" + os.path.abspath("out.html"))
+    a = BilinearForm(
+        InnerProduct(stress(strain(u), mu=mu, lam=lam), strain(v)) * dx, condense=args.condense
+    )
+    solver = LinearSolver.from_args(a, fes.FreeDofs(coupling=args.condense), args)
+    with profiler.phase("assemble"):
+        a.Assemble()
+
+    with profiler.phase("factorize"):
+        solver.update()
+    if args.multi_load:
+        traction = force / (width * height)
+        # Shear (the verification case) and axial tip loads
+        load_cases = [(0, traction), (traction, 0)]
+        rhs = MultiVector(gfu.vec, len(load_cases))
+        solutions = MultiVector(gfu.vec, len(load_cases))
+        for i, load in enumerate(load_cases):
+            rhs[i].data = LinearForm(CoefficientFunction(load) * v * ds("force")).Assemble().vec
+            # cg starts from the current solution, which must not be left uninitialized
+            solutions[i][:] = 0.0
+        with profiler.phase("solve", load_cases=len(load_cases)):
+            solver.solve_multiple(rhs, solutions)
+        tip_size = Integrate(CoefficientFunction(1.0) * ds("force"), mesh)
+        for i in range(len(load_cases)):
+            gfu.vec.data = solutions[i]
+            tip_displacement = np.asarray(Integrate(gfu * ds("force"), mesh)) / tip_size
+            print(f"Load case {i}: mean tip displacement {tip_displacement}")
+        gfu.vec.data = solutions[0]
+    else:
+        f = LinearForm(CoefficientFunction((0, force / (width * height))) * v * ds("force"))
+        f.Assemble()
+        with profiler.phase("solve"):
+            solver.solve(f.vec, gfu.vec)
+
+    with profiler.phase("output"):
+        if args.output:
+            VTKWriter(mesh).write(args.output + ".vtu", point_data={"displacement": gfu})
+        if args.draw:
+            draw(gfu, mesh)
 
     analytical_deflection = analytical_beam_deflection(
         height=height, length=length, E=E, force=force / width
     )
     print(f"Analytical Y deflection: {analytical_deflection:.9f} m")
 
-    coords = np.asarray([node.point for node in mesh.vertices])
-    disp = gfu(mesh(x=coords[:, 0], y=coords[:, 1]))
-    numerical_deflection = np.mean(disp[coords[:, 0] == length, 1])
+    tip = RegionProbe(mesh, "force")
+    numerical_deflection = np.mean(tip(gfu)[:, 1])
     print(f"Numerical Y deflection:  {numerical_deflection:.9f} m")
 
     total_force = Integrate(CoefficientFunction(force / (width * height)) * ds("force"), mesh)
     print(f"Total integrated force: {total_force:.3f} N")
 
+    if args.profile:
+        print(profiler.summary("Phases:"))
+    if args.trace:
+        profiler.write_trace(args.trace)
+
+
+def main() -> None:
+    args = parse_args()
+    run_in_task_manager(run, args)
+
 
 if __name__ == "__main__":
     main()
@@ -1,10 +1,15 @@
-import os.path
-import webbrowser
+import argparse
+import os
 
 import numpy as np
 from netgen.occ import *
 from ngsolve import *
-from ngsolve.webgui import Draw
+
+from output import VTKWriter, add_output_arguments, draw
+from probe import RegionProbe
+from profiling import Profiler, add_profiling_arguments
+from runtime import add_threading_arguments, run_in_task_manager
+from solver import LinearSolver, add_solver_arguments
 
 
 def analytical_beam_deflection(width: float, height: float, length: float, E: float, force: float):
@@ -20,7 +25,54 @@ def strain(displacement):
     return Sym(Grad(displacement))
 
 
-def main() -> None:
+def create_beam_geometry(length: float, height: float, width: float) -> OCCGeometry:
+    beam = Box(Pnt(0, 0, 0), Pnt(length, height, width))
+    beam.faces.Min(X).name = "fix"
+    beam.faces.Max(X).name = "force"
+    return OCCGeometry(beam)
+
+
+def create_beam_mesh(length: float, height: float, width: float, maxh: float) -> Mesh:
+    geo = create_beam_geometry(length=length, height=height, width=width)
+    return Mesh(geo.GenerateMesh(maxh=maxh))
+
+
+def parse_args() -> argparse.Namespace:
+    parser = argparse.ArgumentParser(description="3D cantilever beam")
+    parser.add_argument(
+        "--multi-load",
+        action="store_true",
+        help="solve several tip load cases at once against the same factorization",
+    )
+    parser.add_argument(
+        "--mpi",
+        action="store_true",
+        help="distribute the mesh across the ranks of MPI_COMM_WORLD, to be run with e.g. "
+        "mpirun -np 4, requires --solver cg (--threads defaults to 1)",
+    )
+    add_solver_arguments(parser)
+    add_threading_arguments(parser)
+    # Resolved once --mpi is known
+    parser.set_defaults(threads=None)
+    add_output_arguments(parser)
+    add_profiling_arguments(parser)
+    args = parser.parse_args()
+    if args.threads is None:
+        # Each rank would otherwise start a thread per core, oversubscribing the machine
+        args.threads = 1 if args.mpi else os.cpu_count()
+    if args.mpi:
+        if args.solver != "cg":
+            parser.error("--mpi requires --solver cg, the direct solvers are sequential")
+        if args.preconditioner not in ["bddc", "local"]:
+            parser.error("--mpi requires --preconditioner bddc or local")
+        if args.draw:
+            parser.error("--mpi does not support --draw")
+    return args
+
+
+def run(args: argparse.Namespace) -> None:
+    profiler = Profiler.from_args(args)
+
     # NOTE: All values in standard units: m, N, Pa
     length = 0.2
     height = 0.02
@@ -29,45 +81,103 @@ def main() -> None:
     E = 70e9  # Young's modulus
     nu = 0.35  # Poisson's ratio
 
-    beam = Box(Pnt(0, 0, 0), Pnt(length, height, width))
-    beam.faces.Min(X).name = "fix"
-    beam.faces.Max(X).name = "force"
-    geo = OCCGeometry(beam)
-    mesh = Mesh(geo.GenerateMesh(maxh=height / 5.0))
+    with profiler.phase("mesh"):
+        if args.mpi:
+            # Imported here, so that sequential runs do not depend on mpi4py
+            from mpi4py import MPI
+
+            from parallel import distribute_mesh
+
+            comm = MPI.COMM_WORLD
+            geo = create_beam_geometry(length=length, height=height, width=width)
+            mesh = distribute_mesh(comm, lambda: geo.GenerateMesh(maxh=height / 5.0))
+        else:
+            mesh = create_beam_mesh(length=length, height=height, width=width, maxh=height / 5.0)
+    # Only one rank reports, the reported values are global
+    verbose = not args.mpi or comm.rank == 0
 
     # Lamé parameters
     lam = E * nu / ((1.0 + nu) * (1.0 - 2.0 * nu))
     mu = E / (2.0 * (1.0 + nu))
 
-    fes = VectorH1(mesh, order=2, dirichlet="fix")
-    u = fes.TrialFunction()
-    v = fes.TestFunction()
-    gfu = GridFunction(fes)
-
-    a = BilinearForm(InnerProduct(stress(strain(u), mu=mu, lam=lam), strain(v)) * dx)
-    a.Assemble()
-
-    f = LinearForm(CoefficientFunction((0, force / (width * height), 0)) * v * ds("force"))
-    f.Assemble()
-
-    inv = a.mat.Inverse(freedofs=fes.FreeDofs(), inverse="sparsecholesky")
-    gfu.vec.data = inv * f.vec
+    with profiler.phase("space"):
+        fes = VectorH1(mesh, order=2, dirichlet="fix")
+        u = fes.TrialFunction()
+        v = fes.TestFunction()
+        gfu = GridFunction(fes)
 
-    Draw(gfu, filename="out.html")
-    webbrowser.open("file://" + os.path.abspath("out.html"))
+    a = BilinearForm(
+        InnerProduct(stress(strain(u), mu=mu, lam=lam), strain(v)) * dx, condense=args.condense
+    )
+    solver = LinearSolver.from_args(a, fes.FreeDofs(coupling=args.condense), args)
+    with profiler.phase("assemble"):
+        a.Assemble()
+
+    with profiler.phase("factorize"):
+        solver.update()
+    if args.multi_load:
+        traction = force / (width * height)
+        # Vertical shear (the verification case), axial and lateral shear tip loads
+        load_cases = [(0, traction, 0), (traction, 0, 0), (0, 0, traction)]
+        rhs = MultiVector(gfu.vec, len(load_cases))
+        solutions = MultiVector(gfu.vec, len(load_cases))
+        for i, load in enumerate(load_cases):
+            rhs[i].data = LinearForm(CoefficientFunction(load) * v * ds("force")).Assemble().vec
+            # cg starts from the current solution, which must not be left uninitialized
+            solutions[i][:] = 0.0
+        with profiler.phase("solve", load_cases=len(load_cases)):
+            solver.solve_multiple(rhs, solutions)
+        tip_size = Integrate(CoefficientFunction(1.0) * ds("force"), mesh)
+        for i in range(len(load_cases)):
+            gfu.vec.data = solutions[i]
+            tip_displacement = np.asarray(Integrate(gfu * ds("force"), mesh)) / tip_size
+            if verbose:
+                print(f"Load case {i}: mean tip displacement {tip_displacement}")
+        gfu.vec.data = solutions[0]
+    else:
+        f = LinearForm(CoefficientFunction((0, force / (width * height), 0)) * v * ds("force"))
+        f.Assemble()
+        with profiler.phase("solve"):
+            solver.solve(f.vec, gfu.vec)
+
+    with profiler.phase("output"):
+        if args.output and not args.mpi:
+            VTKWriter(mesh).write(args.output + ".vtu", point_data={"displacement": gfu})
+        elif args.output and mesh.ne > 0:
+            # One piece per rank, of the elements it holds
+            filename = f"{args.output}_{comm.rank}.vtu"
+            VTKWriter(mesh).write(filename, point_data={"displacement": gfu})
+        if args.draw:
+            draw(gfu, mesh)
 
     analytical_deflection = analytical_beam_deflection(
         width=width, height=height, length=length, E=E, force=force
     )
-    print(f"Analytical Y deflection: {analytical_deflection:.9f} m")
+    if args.mpi:
+        # The vertices of the tip are spread over the ranks, some of them shared, so the mean is
+        # taken as an integral, which Integrate sums over the ranks
+        tip_size = Integrate(CoefficientFunction(1.0) * ds("force"), mesh)
+        numerical_deflection = Integrate(gfu[1] * ds("force"), mesh) / tip_size
+    else:
+        tip = RegionProbe(mesh, "force")
+        numerical_deflection = np.mean(tip(gfu)[:, 1])
+    total_force = Integrate(CoefficientFunction(force / (width * height)) * ds("force"), mesh)
 
-    coords = np.asarray([node.point for node in mesh.vertices])
-    disp = gfu(mesh(x=coords[:, 0], y=coords[:, 1], z=coords[:, 2]))
-    numerical_deflection = np.mean(disp[coords[:, 0] == length, 1])
-    print(f"Numerical Y deflection:  {numerical_deflection:.9f} m")
+    if verbose:
+        print(f"Analytical Y deflection: {analytical_deflection:.9f} m")
+        print(f"Numerical Y deflection:  {numerical_deflection:.9f} m")
+        print(f"Total integrated force: {total_force:.3f} N")
 
-    total_force = Integrate(CoefficientFunction(force / (width * height)) * ds("force"), mesh)
-    print(f"Total integrated force: {total_force:.3f} N")
+    if args.profile and verbose:
+        print(profiler.summary("Phases:"))
+    if args.trace:
+        # One trace per rank
+        profiler.write_trace(f"{args.trace}.{comm.rank}" if args.mpi else args.trace)
+
+
+def main() -> None:
+    args = parse_args()
+    run_in_task_manager(run, args)
 
 
 if __name__ == "__main__":
@@ -0,0 +1,55 @@
+import numpy as np
+from ngsolve import *
+
+
+class Springs:
+    """Grounded linear springs acting on single DOFs, added to the diagonal of a sparse matrix.
+
+    The diagonal positions in the CSR values are looked up once; the matrix must keep its sparsity
+    pattern (as for a reassembled BilinearForm or the StructuredAssembler).
+    """
+
+    def __init__(self, mat, dofs: list[int], stiffness: list[float]):
+        self.dofs = np.asarray(dofs)
+        self.stiffness = np.asarray(stiffness, dtype=float)
+        _, cols, rowptr = mat.CSR()
+        self.positions = np.array(
+            [
+                rowptr[dof] + np.searchsorted(cols[rowptr[dof] : rowptr[dof + 1]], dof)
+                for dof in dofs
+            ]
+        )
+
+    def add_to(self, mat) -> None:
+        """Adds the springs to a freshly assembled matrix"""
+        mat.AsVector().FV().NumPy()[self.positions] += self.stiffness
+
+
+def inverter_dofs(nx: int, ny: int) -> tuple[int, int, list[int]]:
+    """Input, output and fixed DOFs of the force inverter on a create_quad_mesh grid.
+
+    Only the lower half of the inverter is modeled, with a symmetry condition on the bottom edge
+    (not included here). The input force pushes the bottom left vertex in +x and the output is the
+    x displacement of the bottom right vertex, which should move in -x. Both components of a few
+    vertices at the top of the left edge are fixed. DOFs are those of an order 1 VectorH1 space.
+    """
+    num_points = (nx + 1) * (ny + 1)
+    input_dof = 0
+    output_dof = nx
+    fixed_points = [iy * (nx + 1) for iy in range(ny - max(1, ny // 20), ny + 1)]
+    fixed_dofs = fixed_points + [num_points + p for p in fixed_points]
+    return input_dof, output_dof, fixed_dofs
+
+
+def adapt_output_spring(
+    spring_out: float, flexibility: float, spring_min: float, spring_max: float
+) -> float:
+    """Adaptive output spring stiffness, after Liu et al. (2020).
+
+    flexibility is the output displacement under a unit output load, i.e. l^T K^-1 l, which is
+    the output value of the adjoint solution and includes the current output spring. The spring is
+    set to the stiffness of the structure alone at the output port, so that it follows the evolving
+    design instead of a fixed guess.
+    """
+    structure_stiffness = 1.0 / flexibility - spring_out
+    return float(np.clip(structure_stiffness, spring_min, spring_max))
@@ -1,54 +1,105 @@
+import numpy as np
 from netgen.meshing import *
 
 
+def add_segments(mesh: Mesh, point_ids: np.ndarray, index: int) -> None:
+    """Adds the boundary segments joining consecutive points of a polyline"""
+    segments = np.stack([point_ids[:-1], point_ids[1:]], axis=1)
+    mesh.AddElements(dim=1, index=index, data=np.ascontiguousarray(segments), base=0)
+
+
+def grid_quads(point_ids: np.ndarray) -> np.ndarray:
+    """Connectivity of the quads of a structured 2D grid of point IDs.
+
+    Quads are ordered (r, c), (r, c + 1), (r + 1, c + 1), (r + 1, c), i.e. counterclockwise when
+    the column index runs along the first axis and the row index along the second one.
+    """
+    quads = np.stack(
+        [point_ids[:-1, :-1], point_ids[:-1, 1:], point_ids[1:, 1:], point_ids[1:, :-1]], axis=-1
+    )
+    return quads.reshape(-1, 4)
+
+
 def create_quad_mesh(size_x: float, size_y: float, nx: int, ny: int) -> Mesh:
     mesh = Mesh(dim=2)
 
-    point_ids = []
-    for iy in range(ny + 1):
-        for ix in range(nx + 1):
-            point_ids.append(mesh.Add(MeshPoint(Pnt(ix / nx * size_x, iy / ny * size_y, 0))))
+    # Point coordinates and connectivity are built as arrays and inserted in bulk
+    x, y = np.meshgrid(np.arange(nx + 1) / nx * size_x, np.arange(ny + 1) / ny * size_y)
+    mesh.AddPoints(np.stack([x.ravel(), y.ravel(), np.zeros(x.size)], axis=1))
+    point_ids = np.arange((nx + 1) * (ny + 1), dtype=np.int32).reshape(ny + 1, nx + 1)
 
     domain_index = mesh.AddRegion("rectangle", dim=2)
-    for iy in range(ny):
-        for ix in range(nx):
-            mesh.Add(
-                Element2D(
-                    domain_index,
-                    [
-                        point_ids[iy * (nx + 1) + ix],
-                        point_ids[iy * (nx + 1) + ix + 1],
-                        point_ids[(iy + 1) * (nx + 1) + ix + 1],
-                        point_ids[(iy + 1) * (nx + 1) + ix],
-                    ],
-                )
-            )
+    mesh.AddElements(dim=2, index=domain_index, data=grid_quads(point_ids), base=0)
 
     fd_bottom = mesh.Add(FaceDescriptor(surfnr=1, domin=domain_index, bc=1))
-    for ix in range(nx):
-        mesh.Add(Element1D([point_ids[ix], point_ids[ix + 1]], index=fd_bottom))
+    add_segments(mesh, point_ids[0, :], index=fd_bottom)
 
-    fd_left = mesh.Add(FaceDescriptor(surfnr=2, domin=domain_index, bc=2))
-    for iy in range(ny):
-        mesh.Add(
-            Element1D(
-                [point_ids[iy * (nx + 1) + nx], point_ids[(iy + 1) * (nx + 1) + nx]], index=fd_left
-            )
-        )
+    fd_right = mesh.Add(FaceDescriptor(surfnr=2, domin=domain_index, bc=2))
+    add_segments(mesh, point_ids[:, nx], index=fd_right)
 
     fd_top = mesh.Add(FaceDescriptor(surfnr=3, domin=domain_index, bc=3))
-    for ix in range(nx):
-        mesh.Add(
-            Element1D(
-                [point_ids[ny * (nx + 1) + ix], point_ids[ny * (nx + 1) + ix + 1]], index=fd_top
-            )
-        )
-
-    fd_right = mesh.Add(FaceDescriptor(surfnr=4, domin=domain_index, bc=4))
-    for iy in range(ny):
-        mesh.Add(
-            Element1D([point_ids[iy * (nx + 1)], point_ids[(iy + 1) * (nx + 1)]], index=fd_right)
-        )
+    add_segments(mesh, point_ids[ny, :], index=fd_top)
+
+    fd_left = mesh.Add(FaceDescriptor(surfnr=4, domin=domain_index, bc=4))
+    add_segments(mesh, point_ids[:, 0], index=fd_left)
+
+    for bc, name in enumerate(["bottom", "right", "top", "left"]):
+        mesh.SetBCName(bc, name)
+
+    mesh.Compress()
+
+    return mesh
+
+
+def create_hex_mesh(
+    size_x: float, size_y: float, size_z: float, nx: int, ny: int, nz: int
+) -> Mesh:
+    mesh = Mesh(dim=3)
+
+    x, y, z = np.meshgrid(
+        np.arange(nx + 1) / nx * size_x,
+        np.arange(ny + 1) / ny * size_y,
+        np.arange(nz + 1) / nz * size_z,
+        indexing="ij",
+    )
+    # Points are numbered with x running fastest, then y, then z
+    points = np.stack([x.ravel(order="F"), y.ravel(order="F"), z.ravel(order="F")], axis=1)
+    mesh.AddPoints(np.ascontiguousarray(points))
+    point_ids = np.arange(points.shape[0], dtype=np.int32).reshape(nz + 1, ny + 1, nx + 1)
+
+    domain_index = mesh.AddRegion("box", dim=3)
+    hexes = np.stack(
+        [
+            point_ids[:-1, :-1, :-1],
+            point_ids[:-1, :-1, 1:],
+            point_ids[:-1, 1:, 1:],
+            point_ids[:-1, 1:, :-1],
+            point_ids[1:, :-1, :-1],
+            point_ids[1:, :-1, 1:],
+            point_ids[1:, 1:, 1:],
+            point_ids[1:, 1:, :-1],
+        ],
+        axis=-1,
+    )
+    mesh.AddElements(dim=3, index=domain_index, data=hexes.reshape(-1, 8), base=0)
+
+    # Boundary quads must be oriented with their normal pointing out of the box. grid_quads()
+    # produces the normal (column axis) x (row axis), so some faces are flipped.
+    faces = [
+        ("left", point_ids[:, :, 0], True),
+        ("right", point_ids[:, :, nx], False),
+        ("bottom", point_ids[:, 0, :], False),
+        ("top", point_ids[:, ny, :], True),
+        ("back", point_ids[0, :, :], True),
+        ("front", point_ids[nz, :, :], False),
+    ]
+    for bc, (name, face_ids, flip) in enumerate(faces):
+        fd = mesh.Add(FaceDescriptor(surfnr=bc + 1, domin=domain_index, bc=bc + 1))
+        quads = grid_quads(face_ids)
+        if flip:
+            quads = quads[:, ::-1]
+        mesh.AddElements(dim=2, index=fd, data=np.ascontiguousarray(quads), base=0)
+        mesh.SetBCName(bc, name)
 
     mesh.Compress()
 
@@ -0,0 +1,211 @@
+import numpy as np
+
+
+class MMA:
+    """Method of moving asymptotes (Svanberg, 1987 and 2007), for multiple constraints.
+
+    Solves min f0(x) subject to fi(x) <= 0 (i = 1..m) and x_min <= x <= x_max, one update() per
+    optimization iteration. Each subproblem is a separable convex approximation, solved through
+    its dual, which only has the m multipliers as unknowns: for given multipliers, the primal
+    minimizer has a closed form per variable, evaluated for all the variables at once. All the
+    work per dual iteration is a handful of NumPy operations on (m, n) arrays, so it scales to
+    millions of design variables as long as m is small.
+
+    As in Svanberg's implementation, each constraint gets an elastic variable y_i >= 0 (fi <= y_i)
+    penalized by c y_i + d y_i^2 / 2, which keeps the subproblem feasible and its dual bounded.
+    """
+
+    def __init__(
+        self,
+        num_constraints: int,
+        x_min=0.0,
+        x_max=1.0,
+        move: float = 0.5,
+        asymptote_init: float = 0.5,
+        asymptote_increase: float = 1.2,
+        asymptote_decrease: float = 0.7,
+        c: float = 1000.0,
+        d: float = 1.0,
+    ):
+        self.num_constraints = num_constraints
+        self.x_min = x_min
+        self.x_max = x_max
+        self.move = move
+        self.asymptote_init = asymptote_init
+        self.asymptote_increase = asymptote_increase
+        self.asymptote_decrease = asymptote_decrease
+        self.c = np.full(num_constraints, c)
+        self.d = np.full(num_constraints, d)
+        self.iteration = 0
+        self.x_old1 = None
+        self.x_old2 = None
+        self.low = None
+        self.upp = None
+
+    def state(self) -> dict:
+        """The state carried between iterations, e.g. for a checkpoint"""
+        if self.iteration == 0:
+            return {"mma_iteration": 0}
+        state = {
+            "mma_iteration": self.iteration,
+            "mma_x_old1": self.x_old1,
+            "mma_low": self.low,
+            "mma_upp": self.upp,
+        }
+        if self.x_old2 is not None:
+            state["mma_x_old2"] = self.x_old2
+        return state
+
+    def load_state(self, state: dict) -> None:
+        self.iteration = int(state["mma_iteration"])
+        if self.iteration > 0:
+            self.x_old1 = state["mma_x_old1"]
+            self.x_old2 = state.get("mma_x_old2")
+            self.low = state["mma_low"]
+            self.upp = state["mma_upp"]
+
+    def update(
+        self, x: np.ndarray, df0: np.ndarray, fval: np.ndarray, dfdx: np.ndarray
+    ) -> np.ndarray:
+        """New design from the objective gradient df0 (n,), the constraint values fval (m,) and
+        their gradients dfdx (m, n), at the current design x. The objective value itself does
+        not enter the subproblem."""
+        x_range = self.x_max - self.x_min
+        self._update_asymptotes(x, x_range)
+
+        # Move limits, also keeping away from the asymptotes
+        alpha = np.maximum.reduce(
+            [
+                np.broadcast_to(self.x_min, x.shape),
+                self.low + 0.1 * (x - self.low),
+                x - self.move * x_range,
+            ]
+        )
+        beta = np.minimum.reduce(
+            [
+                np.broadcast_to(self.x_max, x.shape),
+                self.upp - 0.1 * (self.upp - x),
+                x + self.move * x_range,
+            ]
+        )
+
+        # Convex approximations f~ = r + sum_j p_j / (upp_j - x_j) + q_j / (x_j - low_j)
+        ux2 = (self.upp - x) ** 2
+        xl2 = (x - self.low) ** 2
+        regularization = 1e-5 / x_range
+        p0 = ux2 * (1.001 * np.maximum(df0, 0.0) + 0.001 * np.maximum(-df0, 0.0) + regularization)
+        q0 = xl2 * (0.001 * np.maximum(df0, 0.0) + 1.001 * np.maximum(-df0, 0.0) + regularization)
+        p = ux2 * (1.001 * np.maximum(dfdx, 0.0) + 0.001 * np.maximum(-dfdx, 0.0) + regularization)
+        q = xl2 * (0.001 * np.maximum(dfdx, 0.0) + 1.001 * np.maximum(-dfdx, 0.0) + regularization)
+        # The constraints of the subproblem are sum_j ... <= b (+ y)
+        b = p @ (1.0 / (self.upp - x)) + q @ (1.0 / (x - self.low)) - fval
+
+        x_new = self._solve_dual(p0, q0, p, q, b, alpha, beta)
+
+        self.x_old2 = self.x_old1
+        self.x_old1 = x.copy()
+        self.iteration += 1
+        return x_new
+
+    def _update_asymptotes(self, x: np.ndarray, x_range) -> None:
+        if self.iteration < 2:
+            self.low = x - self.asymptote_init * x_range
+            self.upp = x + self.asymptote_init * x_range
+            return
+        # Oscillating variables get closer asymptotes, monotonic ones wider asymptotes
+        trend = (x - self.x_old1) * (self.x_old1 - self.x_old2)
+        gamma = np.where(
+            trend < 0.0,
+            self.asymptote_decrease,
+            np.where(trend > 0.0, self.asymptote_increase, 1.0),
+        )
+        self.low = np.clip(
+            x - gamma * (self.x_old1 - self.low), x - 10.0 * x_range, x - 0.01 * x_range
+        )
+        self.upp = np.clip(
+            x + gamma * (self.upp - self.x_old1), x + 0.01 * x_range, x + 10.0 * x_range
+        )
+
+    def _solve_dual(
+        self,
+        p0: np.ndarray,
+        q0: np.ndarray,
+        p: np.ndarray,
+        q: np.ndarray,
+        b: np.ndarray,
+        alpha: np.ndarray,
+        beta: np.ndarray,
+        max_iterations: int = 100,
+        tolerance: float = 1e-9,
+    ) -> np.ndarray:
+        """Maximizes the concave dual function over the multipliers lam >= 0 with a projected
+        Newton method, and returns the corresponding primal minimizer"""
+        low, upp = self.low, self.upp
+
+        def primal(lam: np.ndarray):
+            P = p0 + lam @ p
+            Q = q0 + lam @ q
+            sp, sq = np.sqrt(P), np.sqrt(Q)
+            x = np.clip((low * sp + upp * sq) / (sp + sq), alpha, beta)
+            y = np.maximum(0.0, (lam - self.c) / self.d)
+            return x, y, P, Q
+
+        def dual(lam: np.ndarray):
+            x, y, P, Q = primal(lam)
+            ux = 1.0 / (upp - x)
+            xl = 1.0 / (x - low)
+            value = (
+                np.sum(P * ux + Q * xl)
+                - lam @ b
+                + np.sum(self.c * y + 0.5 * self.d * y**2 - lam * y)
+            )
+            gradient = p @ ux + q @ xl - b - y
+            return value, gradient, x, y, P, Q
+
+        lam = np.ones(self.num_constraints)
+        value, gradient, x, y, P, Q = dual(lam)
+        for _ in range(max_iterations):
+            # Multipliers at their bound with an ascent direction pointing outside stay there
+            free = (lam > 0.0) | (gradient > 0.0)
+            if np.linalg.norm(gradient[free]) <= tolerance * max(1.0, np.abs(value)):
+                break
+
+            # Hessian of the dual, from the variables strictly inside their move limits
+            ux = 1.0 / (upp - x)
+            xl = 1.0 / (x - low)
+            inside = (x > alpha) & (x < beta)
+            dg = p * ux**2 - q * xl**2
+            curvature = 2.0 * P * ux**3 + 2.0 * Q * xl**3
+            hessian = -(dg[:, inside] / curvature[inside]) @ dg[:, inside].T
+            hessian -= np.diag(np.where(lam > self.c, 1.0 / self.d, 0.0))
+            hessian = hessian[np.ix_(free, free)]
+            # Keeps the Hessian invertible when few variables are inside their move limits
+            scale = 1.0 + np.max(np.abs(hessian), initial=0.0)
+            hessian -= 1e-12 * scale * np.eye(len(hessian))
+            direction = np.zeros_like(lam)
+            if np.any(inside) or np.any(lam > self.c):
+                try:
+                    direction[free] = np.linalg.solve(-hessian, gradient[free])
+                except np.linalg.LinAlgError:
+                    direction[free] = gradient[free]
+            else:
+                # The dual is piecewise linear here, fall back to the projected gradient
+                direction[free] = gradient[free]
+
+            # Projected backtracking line search on the dual value
+            step = 1.0
+            for _ in range(50):
+                lam_new = np.maximum(lam + step * direction, 0.0)
+                new = dual(lam_new)
+                if new[0] >= value:
+                    break
+                step *= 0.5
+            else:
+                break
+            if np.max(np.abs(lam_new - lam)) <= tolerance * max(1.0, np.max(lam)):
+                lam = lam_new
+                x = new[2]
+                break
+            lam = lam_new
+            value, gradient, x, y, P, Q = new
+        return x
@@ -0,0 +1,179 @@
+import numpy as np
+from ngsolve import *
+from ngsolve.la import SparseMatrixd
+
+from mesh import create_quad_mesh
+from structured import StructuredAssembler, cell_matrix
+
+
+def grid_prolongation(nx: int, ny: int):
+    """Bilinear interpolation from an order 1 VectorH1 space on an nx x ny create_quad_mesh grid
+    to the space on the 2nx x 2ny grid of the same domain, as a sparse matrix"""
+
+    def interpolation_1d(n: int):
+        # Fine points on coarse points take their value, the others the mean of their neighbours
+        fine = np.arange(2 * n + 1)
+        rows = np.concatenate([fine, fine[1::2]])
+        cols = np.concatenate([fine // 2, fine[1::2] // 2 + 1])
+        weights = np.concatenate([np.where(fine % 2 == 0, 1.0, 0.5), np.full(n, 0.5)])
+        return rows, cols, weights
+
+    rx, cx, wx = interpolation_1d(nx)
+    ry, cy, wy = interpolation_1d(ny)
+    rows = (ry[:, None] * (2 * nx + 1) + rx[None, :]).ravel()
+    cols = (cy[:, None] * (nx + 1) + cx[None, :]).ravel()
+    weights = (wy[:, None] * wx[None, :]).ravel()
+    # Components are blocked, both are interpolated in the same way
+    fine_points = (2 * nx + 1) * (2 * ny + 1)
+    coarse_points = (nx + 1) * (ny + 1)
+    return SparseMatrixd.CreateFromCOO(
+        np.concatenate([rows, rows + fine_points]),
+        np.concatenate([cols, cols + coarse_points]),
+        np.concatenate([weights, weights]),
+        2 * fine_points,
+        2 * coarse_points,
+    )
+
+
+def vertex_blocks(free: np.ndarray) -> list:
+    """Blocks of the free DOFs of each vertex, for a blocked two component space whose free DOFs
+    are given as a boolean array. Vertices with a single free DOF (e.g. on a roller support) get
+    a block of that DOF alone, vertices without free DOFs no block."""
+    num_points = len(free) // 2
+    points = np.arange(num_points)
+    dofs = np.stack([points, points + num_points], axis=1)
+    mask = free[dofs]
+    both = mask.all(axis=1)
+    single = dofs[mask & ~both[:, None]]
+    return dofs[both].tolist() + single.reshape(-1, 1).tolist()
+
+
+class GeometricMultigrid(BaseMatrix):
+    """Geometric multigrid V-cycle preconditioner on a hierarchy of create_quad_mesh grids.
+
+    The grid is halved in both directions as long as possible, down to coarsest_cells cells in
+    the shorter direction. The coarse operators are rediscretized with the StructuredAssembler of
+    each level: the stiffness scale of a coarse cell is the mean of those of its four children,
+    which keeps the void regions of a SIMP design soft on the coarse levels as well, instead of
+    smearing stiff material into them.
+
+    The smoother is a symmetric block Gauss-Seidel over the two DOFs of each vertex, which treats
+    the coupled displacement components of elasticity together and is, like any Gauss-Seidel,
+    insensitive to the scaling of the rows by the stiffness contrast. The coarsest level is solved
+    with a sparse direct factorization. The cycle is symmetric, as required by cg.
+    """
+
+    def __init__(
+        self,
+        nx: int,
+        ny: int,
+        size_x: float,
+        size_y: float,
+        integrand,
+        smoothing_steps: int = 2,
+        coarsest_cells: int = 4,
+    ):
+        super().__init__()
+        self.smoothing_steps = smoothing_steps
+        self.sizes = [(nx, ny)]
+        while nx % 2 == 0 and ny % 2 == 0 and min(nx, ny) // 2 >= coarsest_cells:
+            nx, ny = nx // 2, ny // 2
+            self.sizes.append((nx, ny))
+
+        # The finest operator is the matrix of the system itself, given to update()
+        self.forms = [None]
+        self.assemblers = [None]
+        self.prolongations = []
+        self.restrictions = []
+        for nx, ny in self.sizes[1:]:
+            mesh = Mesh(create_quad_mesh(size_x=size_x, size_y=size_y, nx=nx, ny=ny))
+            fes = VectorH1(mesh, order=1)
+            u, v = fes.TnT()
+            # Only assembled to allocate the matrix, the values come from the assembler
+            a = BilinearForm(integrand(u, v) * dx).Assemble()
+            element_matrix = cell_matrix(size_x / nx, size_y / ny, integrand)
+            self.forms.append(a)
+            self.assemblers.append(StructuredAssembler(a.mat, nx, ny, element_matrix))
+            prolongation = grid_prolongation(nx, ny)
+            self.prolongations.append(prolongation)
+            self.restrictions.append(prolongation.CreateTranspose())
+
+        self.mats = [None] * len(self.sizes)
+        self.projectors = [None] * len(self.sizes)
+        self.smoothers = [None] * len(self.sizes)
+        self.free = [None] * len(self.sizes)
+        self.blocks = [None] * len(self.sizes)
+        self.coarse_inverse = None
+        self.vectors = None
+
+    @property
+    def num_levels(self) -> int:
+        return len(self.sizes)
+
+    def update(self, mat, element_scale: np.ndarray, free: np.ndarray) -> None:
+        """Rebuilds the hierarchy for new matrix values.
+
+        mat is the (already assembled) fine matrix, element_scale the stiffness scale of each
+        fine cell used to assemble it, and free the fine free DOFs as a boolean array.
+        """
+        self.mats[0] = mat
+        for level in range(self.num_levels):
+            if level > 0:
+                (nx, ny), (fine_nx, fine_ny) = self.sizes[level], self.sizes[level - 1]
+                element_scale = element_scale.reshape(ny, 2, nx, 2).mean(axis=(1, 3)).ravel()
+                # Coarse points coincide with the fine points of even indices
+                iy, ix = np.meshgrid(np.arange(ny + 1), np.arange(nx + 1), indexing="ij")
+                points = (2 * iy * (fine_nx + 1) + 2 * ix).ravel()
+                fine_points = (fine_nx + 1) * (fine_ny + 1)
+                free = np.concatenate([free[points], free[points + fine_points]])
+                self.assemblers[level].assemble(element_scale)
+                self.mats[level] = self.forms[level].mat
+
+            freedofs = BitArray(free.tolist())
+            self.projectors[level] = Projector(freedofs, True)
+            if level == self.num_levels - 1:
+                self.coarse_inverse = self.mats[level].Inverse(
+                    freedofs=freedofs, inverse="sparsecholesky"
+                )
+                continue
+            # The blocks only depend on the free DOFs, which often stay the same between updates
+            if self.free[level] is None or not np.array_equal(self.free[level], free):
+                self.blocks[level] = vertex_blocks(free)
+                self.free[level] = free
+            self.smoothers[level] = self.mats[level].CreateBlockSmoother(self.blocks[level])
+
+        if self.vectors is None:
+            self.vectors = [
+                (m.CreateColVector(), m.CreateColVector(), m.CreateColVector())
+                for m in self.mats
+            ]
+
+    def Height(self) -> int:
+        return self.mats[0].height
+
+    def Width(self) -> int:
+        return self.mats[0].width
+
+    def Mult(self, x: BaseVector, y: BaseVector) -> None:
+        self._cycle(0, x, y)
+
+    def _cycle(self, level: int, rhs: BaseVector, sol: BaseVector) -> None:
+        if level == self.num_levels - 1:
+            sol.data = self.coarse_inverse * rhs
+            return
+        mat = self.mats[level]
+        smoother = self.smoothers[level]
+        projector = self.projectors[level]
+        residual = self.vectors[level][0]
+        coarse_rhs, coarse_sol = self.vectors[level + 1][1:]
+
+        sol[:] = 0.0
+        smoother.Smooth(sol, rhs, self.smoothing_steps)
+        residual.data = rhs - mat * sol
+        projector.Project(residual)
+        coarse_rhs.data = self.restrictions[level] * residual
+        self._cycle(level + 1, coarse_rhs, coarse_sol)
+        residual.data = self.prolongations[level] * coarse_sol
+        projector.Project(residual)
+        sol.data += residual
+        smoother.SmoothBack(sol, rhs, self.smoothing_steps)
@@ -1,10 +1,33 @@
-import os.path
-import webbrowser
+import argparse
+import time
 
+import numpy as np
 from ngsolve import *
-from ngsolve.webgui import Draw
 
+from cut import CutAssembler, DensityLevelSet, ghost_penalty_matrices, subcell_matrices
+from filters import GridFilter, HelmholtzFilter, heaviside_derivative, heaviside_projection
+from history import History
+from mechanism import Springs, adapt_output_spring, inverter_dofs
 from mesh import create_quad_mesh
+from mma import MMA
+from multigrid import GeometricMultigrid
+from output import VTKWriter, add_output_arguments, draw
+from profiling import Profiler, add_profiling_arguments
+from runtime import add_threading_arguments, run_in_task_manager
+from sensitivity import (
+    AdjointSolution,
+    element_energy,
+    simp_stiffness,
+    simp_stiffness_derivative,
+)
+from solver import LinearSolver, add_solver_arguments
+from structured import (
+    StructuredAssembler,
+    anchored_cells,
+    cell_matrix,
+    dilate_cells,
+    quad_element_dofs,
+)
 
 
 def stress(strain, mu, lam):
@@ -15,37 +38,657 @@ def strain(displacement):
     return Sym(Grad(displacement))
 
 
-def main() -> None:
-    length = 0.2
-    height = 0.02
-    width = 0.03
-    force = -100.0
-    E = 70e9  # Young's modulus
-    nu = 0.35  # Poisson's ratio
+def optimality_criteria_update(
+    x: np.ndarray,
+    dc: np.ndarray,
+    dv: np.ndarray,
+    volume_fraction: float,
+    move: float = 0.2,
+    volume=None,
+    damping: float = 0.5,
+) -> np.ndarray:
+    """Optimality criteria update, with bisection on the volume constraint Lagrange multiplier.
+
+    volume(x) is the volume fraction of the physical density obtained from the design x (e.g.
+    after filtering and projection), np.dot(x, dv) / np.sum(dv) by default. The damping exponent
+    is usually lowered from 0.5 to 0.3 for non-self-adjoint problems such as mechanisms.
+    """
+    if volume is None:
+
+        def volume(x: np.ndarray) -> float:
+            return np.dot(x, dv) / np.sum(dv)
+
+    x_min = np.maximum(x - move, 0.0)
+    x_max = np.minimum(x + move, 1.0)
+    # dc <= 0 for the compliance (up to round-off), not necessarily for other objectives
+    ratio = np.maximum(-dc, 1e-10) / dv
+    l1, l2 = 0.0, 1e9
+    while (l2 - l1) / (l1 + l2) > 1e-6:
+        l_mid = 0.5 * (l1 + l2)
+        x_new = np.clip(x * (ratio / l_mid) ** damping, x_min, x_max)
+        if volume(x_new) > volume_fraction:
+            l1 = l_mid
+        else:
+            l2 = l_mid
+    return x_new
+
+
+def parse_args() -> argparse.Namespace:
+    parser = argparse.ArgumentParser(description="SIMP topology optimization")
+    parser.add_argument(
+        "--problem",
+        choices=["cantilever", "mechanism"],
+        default="cantilever",
+        help="compliance minimization of a cantilever, or output displacement maximization of a "
+        "force inverter compliant mechanism",
+    )
+    parser.add_argument("--spring-in", type=float, default=0.1, help="input spring stiffness")
+    parser.add_argument("--spring-out", type=float, default=0.1, help="output spring stiffness")
+    parser.add_argument(
+        "--adaptive-spring",
+        action="store_true",
+        help="adapt the output spring stiffness to the structure every iteration",
+    )
+    parser.add_argument(
+        "--assembly",
+        choices=["structured", "generic"],
+        default="structured",
+        help="scale a single precomputed element matrix (structured) or integrate every element "
+        "with BilinearForm.Assemble (generic)",
+    )
+    parser.add_argument(
+        "--filter",
+        choices=["density", "sensitivity", "none"],
+        default="density",
+        help="regularization of the design field",
+    )
+    parser.add_argument(
+        "--filter-type",
+        choices=["grid", "helmholtz"],
+        default="grid",
+        help="convolution on the structured grid, or PDE filter usable on any mesh",
+    )
+    parser.add_argument(
+        "--filter-radius",
+        type=float,
+        default=1.5,
+        help="filter radius, in number of elements",
+    )
+    parser.add_argument(
+        "--projection",
+        action="store_true",
+        help="Heaviside projection of the filtered density (requires the density filter)",
+    )
+    parser.add_argument("--eta", type=float, default=0.5, help="projection threshold")
+    parser.add_argument("--beta", type=float, default=1.0, help="initial projection sharpness")
+    parser.add_argument("--beta-max", type=float, default=32.0, help="final projection sharpness")
+    parser.add_argument(
+        "--beta-interval",
+        type=int,
+        default=50,
+        help="number of iterations between doublings of beta",
+    )
+    parser.add_argument(
+        "--analysis",
+        choices=["ersatz", "cut"],
+        default="ersatz",
+        help="SIMP stiffness interpolation in every element (ersatz), or integration over the "
+        "material side of a level of the filtered density only (cut), void cells dropping out",
+    )
+    parser.add_argument(
+        "--subdivisions",
+        type=int,
+        default=4,
+        help="subcells per cell side, on which the cut cells are integrated",
+    )
+    parser.add_argument(
+        "--ghost-penalty",
+        type=float,
+        default=0.1,
+        help="ghost penalty on the faces of the cut cells, relative to the Young's modulus",
+    )
+    parser.add_argument(
+        "--void-threshold",
+        type=float,
+        metavar="THRESHOLD",
+        help="drop the elements with a physical density at most THRESHOLD from the linear system, "
+        "along with the DOFs no other element shares, except for a layer of elements around the "
+        "structure",
+    )
+    parser.add_argument(
+        "--void-interval",
+        type=int,
+        default=10,
+        help="number of iterations between two updates of the DOFs of the linear system, each of "
+        "which is a factorization from scratch for the direct solvers (DOFs are only added "
+        "earlier when the structure grows beyond them)",
+    )
+    parser.add_argument(
+        "--optimizer",
+        choices=["oc", "mma"],
+        default="oc",
+        help="optimality criteria (single volume constraint), or method of moving asymptotes "
+        "(any number of constraints)",
+    )
+    parser.add_argument(
+        "--displacement-limit",
+        type=float,
+        metavar="LIMIT",
+        help="also constrain the downward displacement of the middle of the loaded edge of the "
+        "cantilever to LIMIT (requires --optimizer mma)",
+    )
+    add_solver_arguments(parser, grid=True)
+    add_threading_arguments(parser)
+    add_output_arguments(parser)
+    add_profiling_arguments(parser)
+    parser.add_argument(
+        "--output-interval",
+        type=int,
+        default=10,
+        help="number of iterations between two snapshots written to PREFIX_<iteration>.vtu",
+    )
+    parser.add_argument(
+        "--history",
+        metavar="DIR",
+        help="stream the iteration history, density snapshots and checkpoints to DIR",
+    )
+    parser.add_argument(
+        "--checkpoint-interval",
+        type=int,
+        default=20,
+        help="number of iterations between two density snapshots and checkpoints",
+    )
+    parser.add_argument(
+        "--restart",
+        action="store_true",
+        help="resume from the last checkpoint in the --history directory",
+    )
+    args = parser.parse_args()
+    if args.restart and not args.history:
+        parser.error("--restart requires --history")
+    if args.projection and args.filter != "density":
+        parser.error("--projection requires --filter density")
+    if args.displacement_limit is not None:
+        if args.optimizer != "mma":
+            parser.error("--displacement-limit requires --optimizer mma")
+        if args.problem != "cantilever":
+            parser.error("--displacement-limit requires --problem cantilever")
+    if args.analysis == "cut":
+        if args.assembly != "structured":
+            parser.error("--analysis cut requires --assembly structured")
+        if not args.projection:
+            # The boundary is the eta level of the filtered density, sharpened by beta
+            parser.error("--analysis cut requires --projection")
+        if args.void_threshold is not None:
+            parser.error("--analysis cut already drops the void cells, without --void-threshold")
+    if args.assembly == "structured" and args.condense:
+        parser.error("structured assembly does not support --condense")
+    if args.assembly == "structured" and args.solver == "cg":
+        if args.preconditioner not in ["local", "gmg"]:
+            # The other preconditioners are built from the element matrices during Assemble
+            parser.error("structured assembly requires --preconditioner local or gmg with cg")
+    if args.preconditioner == "gmg" and args.condense:
+        parser.error("--preconditioner gmg does not support --condense")
+    return args
+
+
+def run(args: argparse.Namespace) -> None:
+    profiler = Profiler.from_args(args)
+
+    # Nondimensional unit material and load, as in the 88-line code, instead of the SI beam of
+    # linear_elasticity_2d.py: the compliance and E_min do not depend on the units
+    size_x = 2.0
+    size_y = 1.0
+    nx = 120
+    ny = 60
+    force = -1.0
+    force_in = 1.0
+    E = 1.0  # Young's modulus of the solid material
+    E_min = 1e-9 * E  # Young's modulus of the void material
+    nu = 0.3  # Poisson's ratio
+    volume_fraction = 0.5 if args.problem == "cantilever" else 0.3
+    penalty = 3.0
+    move = 0.2
+    max_iterations = 500
+    tolerance = 1e-2
 
-    mesh = create_quad_mesh(size_x=length, size_y=height, nx=int(5 * length / height), ny=5)
-    mesh = Mesh(mesh)
+    with profiler.phase("mesh"):
+        mesh = create_quad_mesh(size_x=size_x, size_y=size_y, nx=nx, ny=ny)
+        mesh = Mesh(mesh)
 
-    # Lamé parameters
-    lam = E * nu / ((1.0 + nu) * (1.0 - 2.0 * nu))
-    mu = E / (2.0 * (1.0 + nu))
+    # Lamé parameters of a unit Young's modulus material, scaled by the interpolated stiffness
+    lam = nu / ((1.0 + nu) * (1.0 - 2.0 * nu))
+    mu = 1.0 / (2.0 * (1.0 + nu))
 
-    fes = VectorH1(mesh, order=2, dirichlet="fix")
+    # All the FE machinery is built once, only the density values change between iterations.
+    # Order 1, one DOF per grid vertex, so that each bilinear element carries one density.
+    if args.problem == "mechanism":
+        # Symmetry of the inverter about its bottom edge, the other supports are single DOFs
+        fes = VectorH1(mesh, order=1, dirichlety="bottom", dgjumps=args.analysis == "cut")
+        input_dof, output_dof, fixed_dofs = inverter_dofs(nx, ny)
+        freedofs = BitArray(fes.FreeDofs(coupling=args.condense))
+        for dof in fixed_dofs:
+            freedofs.Clear(dof)
+    else:
+        fes = VectorH1(mesh, order=1, dirichlet="left", dgjumps=args.analysis == "cut")
+        freedofs = fes.FreeDofs(coupling=args.condense)
     u = fes.TrialFunction()
     v = fes.TestFunction()
     gfu = GridFunction(fes)
 
-    a = BilinearForm(InnerProduct(stress(strain(u), mu=mu, lam=lam), strain(v)) * dx)
-    a.Assemble()
+    # Piecewise constant density, the L2 order 0 DOFs are numbered like the mesh elements
+    fes_rho = L2(mesh, order=0)
+    rho = GridFunction(fes_rho)
+    # The design variables are mapped to the physical density by the filter and projection
+    design = np.full(mesh.ne, volume_fraction)
+
+    stiffness = simp_stiffness(rho, E=E, E_min=E_min, penalty=penalty)
+    # Order 1 elements have no interior DOFs, condensation only matters for higher orders
+    a = BilinearForm(fes, condense=args.condense)
+    a += InnerProduct(stress(strain(u), mu=stiffness * mu, lam=stiffness * lam), strain(v)) * dx
+
+    # Mutual energy density of a unit Young's modulus material
+    def unit_energy(u, w):
+        return InnerProduct(stress(strain(u), mu=mu, lam=lam), strain(w))
+
+    # The mask of the free DOFs, before the elimination of the void elements
+    base_free = np.array(list(freedofs), dtype=bool)
+    multigrid = None
+    if args.solver == "cg" and args.preconditioner == "gmg":
+        multigrid = GeometricMultigrid(nx, ny, size_x, size_y, unit_energy)
+    solver = LinearSolver.from_args(a, freedofs, args, pre=multigrid)
+    if args.assembly == "structured":
+        # Allocates the matrix with the sparsity pattern of the space, values are then overwritten
+        a.Assemble()
+
+        if args.analysis == "cut":
+            # The ghost penalty couples cells sharing a face, hence the dgjumps space
+            cut_assembler = CutAssembler(
+                a.mat,
+                nx=nx,
+                ny=ny,
+                subcell_matrices=subcell_matrices(
+                    size_x / nx, size_y / ny, unit_energy, args.subdivisions
+                ),
+                ghost_matrices=ghost_penalty_matrices(size_x / nx, size_y / ny),
+            )
+            density_level_set = DensityLevelSet(nx, ny, subdivisions=args.subdivisions)
+        else:
+            element_matrix = cell_matrix(size_x / nx, size_y / ny, unit_energy)
+            assembler = StructuredAssembler(a.mat, nx=nx, ny=ny, element_matrix=element_matrix)
+
+    # Solutions reused as initial guesses by iterative solvers
+    warm_started = [gfu]
+    f = LinearForm(fes)
+    if args.problem == "mechanism":
+        f.Assemble()
+        f.vec[input_dof] = force_in
+        # Both load cases share the factorization, the adjoint load is a unit output force
+        output = gfu.vec.CreateVector()
+        output[:] = 0.0
+        output[output_dof] = 1.0
+        adjoint = AdjointSolution(fes, solver, output)
+        warm_started.append(adjoint.gf)
+        spring_out = args.spring_out
+        if args.assembly == "generic":
+            a.Assemble()
+        springs = Springs(a.mat, [input_dof, output_dof], [args.spring_in, spring_out])
+    else:
+        f += CoefficientFunction((0, force / size_y)) * v * ds("right")
+        f.Assemble()
+        if args.displacement_limit is not None:
+            # -u_y / limit - 1 <= 0 at the middle of the loaded edge, a linear output of u
+            displacement_dof = (nx + 1) * (ny + 1) + (ny // 2) * (nx + 1) + nx
+            displacement_output = gfu.vec.CreateVector()
+            displacement_output[:] = 0.0
+            displacement_output[displacement_dof] = -1.0 / args.displacement_limit
+            displacement_adjoint = AdjointSolution(fes, solver, displacement_output)
+            warm_started.append(displacement_adjoint.gf)
+
+    if args.optimizer == "mma":
+        mma = MMA(num_constraints=1 + (args.displacement_limit is not None), move=move)
+        objective_scale = None
+
+    eliminate_void = args.void_threshold is not None or args.analysis == "cut"
+    if eliminate_void:
+        element_dofs = quad_element_dofs(nx, ny)
+        active_dofs = None
+        # The cells held by the supports, or by the springs of the mechanism
+        supported = ~base_free
+        if args.problem == "mechanism":
+            supported[[input_dof, output_dof]] = True
+        anchor_cells = supported[element_dofs].any(axis=1)
+        # The cells of the loaded DOFs (including the unit loads of the adjoint outputs), which
+        # stay in the system even when void, since a load on a dropped DOF would be ignored
+        loaded = f.vec.FV().NumPy() != 0.0
+        if args.displacement_limit is not None:
+            loaded[displacement_dof] = True
+        load_cells = loaded[element_dofs].any(axis=1)
+
+    dv = np.array(Integrate(CoefficientFunction(1.0), mesh, element_wise=True))
+    filter_radius = args.filter_radius * size_x / nx
+    if args.filter_type == "helmholtz":
+        density_filter = HelmholtzFilter(mesh, radius=filter_radius)
+    else:
+        density_filter = GridFilter(nx, ny, size_x=size_x, size_y=size_y, radius=filter_radius)
+    beta = args.beta
+
+    def physical_density(design: np.ndarray) -> np.ndarray:
+        if args.filter != "density":
+            return design
+        filtered = density_filter.apply(design)
+        # The cut analysis projects the filtered density on the subcells instead
+        if args.projection and args.analysis != "cut":
+            return heaviside_projection(filtered, beta=beta, eta=args.eta)
+        return filtered
 
-    f = LinearForm(CoefficientFunction((0, force / (width * height))) * v * ds("force"))
-    f.Assemble()
+    def volume_fraction_of(design: np.ndarray) -> float:
+        if args.analysis == "cut":
+            return density_level_set.volume(physical_density(design), beta=beta, eta=args.eta)
+        return np.dot(physical_density(design), dv) / np.sum(dv)
 
-    inv = a.mat.Inverse(freedofs=fes.FreeDofs(), inverse="sparsecholesky")
-    gfu.vec.data = inv * f.vec
+    def mutual_energy(w: GridFunction) -> np.ndarray:
+        """Unscaled element (or subcell) mutual energies of the displacement and w"""
+        if args.analysis == "cut":
+            return cut_assembler.subcell_energy(gfu.vec, w.vec)
+        if args.assembly == "structured":
+            return assembler.element_energy(gfu.vec, w.vec)
+        return element_energy(mesh, unit_energy, gfu, w)
 
-    Draw(gfu, filename="out.html")
-    webbrowser.open("file://" + os.path.abspath("out.html"))
+    def design_gradient(gradient: np.ndarray) -> np.ndarray:
+        """Chain rule from a gradient with respect to the physical density (or the subcell
+        indicators of the cut analysis) to a gradient with respect to the design"""
+        if args.analysis == "cut":
+            gradient = density_level_set.chain(gradient, density, beta=beta, eta=args.eta)
+        elif args.filter == "density" and args.projection:
+            filtered = density_filter.apply(design)
+            gradient = gradient * heaviside_derivative(filtered, beta=beta, eta=args.eta)
+        if args.filter == "density":
+            gradient = density_filter.apply_transpose(gradient)
+        return gradient
+
+    if args.output:
+        # Snapshots are written in the background while the next iterations run
+        writer = VTKWriter(mesh, asynchronous=True)
+
+    start_iteration = 0
+    if args.history:
+        history = History(args.history, num_elements=mesh.ne, restart=args.restart)
+        if args.restart:
+            # Everything else is rebuilt from the mesh and spaces, only the state is restored
+            state = history.load_checkpoint()
+            start_iteration = int(state["iteration"]) + 1
+            design = state["design"]
+            beta = float(state["beta"])
+            gfu.vec.FV().NumPy()[:] = state["displacement"]
+            if args.problem == "mechanism":
+                spring_out = float(state["spring_out"])
+                springs.stiffness[1] = spring_out
+            if args.optimizer == "mma":
+                mma.load_state(state)
+                objective_scale = float(state["objective_scale"])
+            print(f"Restarting from iteration {start_iteration}")
+
+    for iteration in range(start_iteration, max_iterations):
+        start_time = time.perf_counter()
+        with profiler.phase("filter"):
+            density = physical_density(design)
+            rho.vec.FV().NumPy()[:] = density
+            if args.analysis == "cut":
+                indicator = density_level_set.indicator(density, beta=beta, eta=args.eta)
+                active_cells, cut_cells = density_level_set.classify(indicator)
+                # Material fraction of the cells, for the output
+                output_density = np.mean(indicator, axis=1)
+            else:
+                output_density = density
+        if eliminate_void:
+            with profiler.phase("eliminate"):
+                # Void elements are still assembled (with the cut analysis, as zero), but their
+                # DOFs are no longer free, so the factorization only covers the active structure.
+                # The displacement of the dropped DOFs is zero, as is the sensitivity of the
+                # elements having only dropped DOFs.
+                if args.analysis == "cut":
+                    solid_cells = active_cells
+                else:
+                    solid_cells = density > args.void_threshold
+                # Islands of material not connected to the supports would make the system
+                # singular, they are dropped as well
+                solid_cells = anchored_cells(solid_cells | load_cells, anchor_cells, nx, ny)
+                # Loaded cells cut off from the supports can neither be dropped (the load would be
+                # ignored) nor kept alone (they would float), so no DOF is dropped until the
+                # structure reconnects them, the void keeping its ersatz (or floor) stiffness
+                stranded = np.any(load_cells & ~solid_cells)
+                if args.analysis == "cut":
+                    active_cells = solid_cells
+                if stranded:
+                    kept_cells = np.ones(mesh.ne, dtype=bool)
+                elif args.analysis == "cut":
+                    kept_cells = solid_cells
+                else:
+                    # A layer of void elements around the structure stays in the system, so that
+                    # the elements next to the structure keep a sensitivity, even without a
+                    # filter, and can grow back
+                    kept_cells = dilate_cells(solid_cells, nx, ny)
+                active = np.zeros(fes.ndof, dtype=bool)
+                active[element_dofs[kept_cells]] = True
+                # A new set of free DOFs is a new factorization from scratch instead of a numeric
+                # refactorization, so the set is only updated every void_interval iterations. In
+                # between, the stale DOFs keep the stiffness of their ersatz void elements (or of
+                # the floor of the cut analysis), and the set is only updated early when a solid
+                # cell reaches beyond it, since its fixed DOFs would act as supports.
+                update_dofs = (
+                    active_dofs is None
+                    or stranded
+                    or iteration % args.void_interval == 0
+                    or not np.all(active_dofs[element_dofs[solid_cells]])
+                )
+                if update_dofs and (active_dofs is None or np.any(active != active_dofs)):
+                    if stranded:
+                        print(
+                            f"Iteration {iteration}: the load is not connected to the supports, "
+                            "keeping all the DOFs"
+                        )
+                    solver.set_freedofs(freedofs & BitArray(active.tolist()))
+                    active_dofs = active
+                    # Otherwise the stale displacement of the dropped DOFs (e.g. the warm start of
+                    # cg) would act as a prescribed displacement
+                    for gf in warm_started:
+                        gf.vec.FV().NumPy()[~active] = 0.0
+        with profiler.phase("assemble"):
+            if args.analysis == "cut":
+                cell_scale = cut_assembler.assemble(
+                    indicator,
+                    stiffness=E,
+                    ghost_penalty=args.ghost_penalty,
+                    ghost_faces=cut_assembler.ghost_faces(active_cells, cut_cells),
+                    floor_cells=active_dofs[element_dofs].any(axis=1),
+                )
+            elif args.assembly == "structured":
+                assembler.assemble(simp_stiffness(density, E=E, E_min=E_min, penalty=penalty))
+            else:
+                a.Assemble()
+            if args.problem == "mechanism":
+                springs.add_to(a.mat)
+        with profiler.phase("factorize"):
+            if multigrid is not None:
+                if args.analysis == "cut":
+                    # Includes the stiffness floor, without which the coarse cells of stale free
+                    # DOFs would have no stiffness at all
+                    element_scale = cell_scale
+                else:
+                    element_scale = simp_stiffness(density, E=E, E_min=E_min, penalty=penalty)
+                free = base_free & active_dofs if eliminate_void else base_free
+                multigrid.update(a.mat, element_scale, free)
+            solver.update()
+        with profiler.phase("solve"):
+            # gfu still holds the previous displacement, the initial guess of iterative solvers
+            solver.solve(f.vec, gfu.vec)
+
+        with profiler.phase("sensitivity"):
+            if args.analysis == "cut":
+                # Per subcell, the stiffness is E times the material indicator
+                stiffness_derivative = E
+            else:
+                stiffness_derivative = simp_stiffness_derivative(
+                    density, E=E, E_min=E_min, penalty=penalty
+                )
+            if args.problem == "mechanism":
+                with profiler.phase("adjoint"):
+                    adjoint.solve()
+                ce = mutual_energy(adjoint.gf)
+                # Minimizing the output displacement along +x maximizes the inverted output motion
+                objective = gfu.vec[output_dof]
+                dc = adjoint.sensitivity(stiffness_derivative, ce)
+                if args.adaptive_spring:
+                    spring_out = adapt_output_spring(
+                        spring_out,
+                        flexibility=adjoint.gf.vec[output_dof],
+                        spring_min=1e-3 * args.spring_out,
+                        spring_max=1e3 * args.spring_out,
+                    )
+                    springs.stiffness[1] = spring_out
+            else:
+                if args.analysis == "cut":
+                    ce = cut_assembler.subcell_energy(gfu.vec)
+                    # Includes the (small) ghost penalty energy
+                    objective = InnerProduct(f.vec, gfu.vec)
+                else:
+                    if args.assembly == "structured":
+                        ce = assembler.element_energy(gfu.vec)
+                    else:
+                        ce = element_energy(mesh, unit_energy, gfu)
+                    stiffness = simp_stiffness(density, E=E, E_min=E_min, penalty=penalty)
+                    objective = np.dot(stiffness, ce)
+                # The compliance is self-adjoint, the adjoint solution is the displacement itself
+                dc = -stiffness_derivative * ce
+                if args.displacement_limit is not None:
+                    with profiler.phase("adjoint"):
+                        displacement_adjoint.solve()
+                    displacement_constraint = InnerProduct(displacement_output, gfu.vec) - 1.0
+                    d_displacement = displacement_adjoint.sensitivity(
+                        stiffness_derivative, mutual_energy(displacement_adjoint.gf)
+                    )
+
+        if args.analysis == "cut":
+            volume = np.mean(indicator)
+        else:
+            volume = np.dot(density, dv) / np.sum(dv)
+
+        with profiler.phase("update"):
+            if args.analysis == "cut":
+                # The volume of each subcell, through which the cut volume depends on the design
+                subcells = indicator.shape[1]
+                dv_physical = np.outer(dv, np.full(subcells, 1.0 / subcells))
+            else:
+                dv_physical = dv
+            if args.filter == "sensitivity":
+                dc = density_filter.filter_sensitivity(design, dc)
+            else:
+                dc = design_gradient(dc)
+            dv_design = design_gradient(dv_physical)
+
+            if args.optimizer == "mma":
+                # MMA is not scale invariant, the objective is normalized by its initial value
+                if objective_scale is None:
+                    objective_scale = 1.0 / max(abs(objective), 1e-30)
+                constraints = [volume / volume_fraction - 1.0]
+                constraint_gradients = [dv_design / (np.sum(dv) * volume_fraction)]
+                if args.displacement_limit is not None:
+                    constraints.append(displacement_constraint)
+                    constraint_gradients.append(design_gradient(d_displacement))
+                design_new = mma.update(
+                    design,
+                    objective_scale * dc,
+                    np.array(constraints),
+                    np.stack(constraint_gradients),
+                )
+            else:
+                design_new = optimality_criteria_update(
+                    design,
+                    dc,
+                    dv_design,
+                    volume_fraction,
+                    move=move,
+                    volume=volume_fraction_of,
+                    damping=0.3 if args.problem == "mechanism" else 0.5,
+                )
+            change = np.max(np.abs(design_new - design))
+            design = design_new
+
+        message = (
+            f"It.: {iteration:4d}  Obj.: {objective:.6e}  Vol.: {volume:.3f}  ch.: {change:.3f}"
+        )
+        if args.displacement_limit is not None:
+            message += f"  disp.: {displacement_constraint:+.3f}"
+        if solver.iterative:
+            message += f"  cg it.: {solver.iterations}"
+        if eliminate_void:
+            message += f"  free DOFs: {solver.freedofs.NumSet()}"
+        print(message)
+        if args.output and iteration % args.output_interval == 0:
+            with profiler.phase("output"):
+                writer.write(
+                    f"{args.output}_{iteration:04d}.vtu",
+                    point_data={"displacement": gfu},
+                    cell_data={"density": output_density},
+                )
+
+        # Beta continuation, the projection is sharpened once the design has settled
+        converged = change < tolerance
+        if args.projection and beta < args.beta_max:
+            if (iteration + 1) % args.beta_interval == 0 or converged:
+                beta = min(2.0 * beta, args.beta_max)
+                print(f"Beta: {beta:g}")
+                converged = False
+
+        if args.history:
+            history.append(
+                iteration=iteration,
+                objective=objective,
+                volume=volume,
+                change=change,
+                beta=beta,
+                time=time.perf_counter() - start_time,
+            )
+            if (iteration + 1) % args.checkpoint_interval == 0 or converged:
+                with profiler.phase("checkpoint"):
+                    history.snapshot(iteration, density)
+                    state = {
+                        "design": design,
+                        "beta": beta,
+                        "displacement": gfu.vec.FV().NumPy(),
+                    }
+                    if args.problem == "mechanism":
+                        state["spring_out"] = spring_out
+                    if args.optimizer == "mma":
+                        state.update(mma.state(), objective_scale=objective_scale)
+                    history.save_checkpoint(iteration, **state)
+
+        if args.profile:
+            print(profiler.summary(f"Iteration {iteration}:"))
+
+        if converged:
+            break
+
+    density = physical_density(design)
+    if args.analysis == "cut":
+        density = np.mean(density_level_set.indicator(density, beta=beta, eta=args.eta), axis=1)
+    rho.vec.FV().NumPy()[:] = density
+    if args.output:
+        writer.write(
+            f"{args.output}.vtu", point_data={"displacement": gfu}, cell_data={"density": rho}
+        )
+        writer.close()
+    if args.draw:
+        draw(rho, mesh)
+
+    if args.trace:
+        profiler.write_trace(args.trace)
+
+
+def main() -> None:
+    args = parse_args()
+    run_in_task_manager(run, args)
 
 
 if __name__ == "__main__":
@@ -0,0 +1,248 @@
+import argparse
+
+import numpy as np
+from netgen.geom2d import SplineGeometry
+from ngsolve import *
+
+from adaptivity import AdaptiveMesh, transfer_element_values, zz_error_indicator
+from filters import HelmholtzFilter
+from optimize import optimality_criteria_update, strain, stress
+from output import VTKWriter, add_output_arguments, draw
+from profiling import Profiler, add_profiling_arguments
+from runtime import add_threading_arguments, run_in_task_manager
+from sensitivity import element_energy, simp_stiffness, simp_stiffness_derivative
+from solver import LinearSolver, add_solver_arguments
+
+
+def create_rectangle_geometry(size_x: float, size_y: float) -> SplineGeometry:
+    """Rectangle with the boundary names of create_quad_mesh, meshed with triangles"""
+    geo = SplineGeometry()
+    geo.AddRectangle((0, 0), (size_x, size_y), bcs=["bottom", "right", "top", "left"])
+    return geo
+
+
+class CantileverProblem:
+    """SIMP cantilever on one mesh of the adaptive sequence.
+
+    Everything depending on the mesh (spaces, forms, solver and filter) is built here, so that an
+    adaptation only has to build a new problem and transfer the design variables to it.
+    """
+
+    def __init__(self, mesh: Mesh, args: argparse.Namespace, material: dict, filter_radius):
+        self.mesh = mesh
+        self.material = material
+        self.fes = VectorH1(mesh, order=1, dirichlet="left")
+        u, v = self.fes.TnT()
+        self.gfu = GridFunction(self.fes)
+        self.rho = GridFunction(L2(mesh, order=0))
+
+        mu = material["mu"]
+        lam = material["lam"]
+        stiffness = self.stiffness(self.rho)
+        self.a = BilinearForm(self.fes, condense=args.condense)
+        self.a += (
+            InnerProduct(stress(strain(u), mu=stiffness * mu, lam=stiffness * lam), strain(v))
+            * dx
+        )
+        freedofs = self.fes.FreeDofs(coupling=args.condense)
+        self.solver = LinearSolver.from_args(self.a, freedofs, args)
+        self.f = LinearForm(self.fes)
+        self.f += CoefficientFunction((0, material["force"])) * v * ds("right")
+        self.f.Assemble()
+
+        self.dv = np.array(Integrate(CoefficientFunction(1.0), mesh, element_wise=True))
+        self.density_filter = HelmholtzFilter(mesh, radius=filter_radius)
+
+    def stiffness(self, density):
+        m = self.material
+        return simp_stiffness(density, E=m["E"], E_min=m["E_min"], penalty=m["penalty"])
+
+    def stiffness_derivative(self, density):
+        m = self.material
+        return simp_stiffness_derivative(density, E=m["E"], E_min=m["E_min"], penalty=m["penalty"])
+
+    def solution_stress(self) -> CoefficientFunction:
+        """Stress of the current solution, including the interpolated stiffness"""
+        stiffness = self.stiffness(self.rho)
+        return stress(
+            strain(self.gfu),
+            mu=stiffness * self.material["mu"],
+            lam=stiffness * self.material["lam"],
+        )
+
+
+def parse_args() -> argparse.Namespace:
+    parser = argparse.ArgumentParser(
+        description="SIMP topology optimization of a cantilever on an adaptively refined mesh"
+    )
+    parser.add_argument(
+        "--maxh",
+        type=float,
+        default=1.0 / 30,
+        help="size of the coarse mesh, kept in the void and solid regions",
+    )
+    parser.add_argument(
+        "--levels", type=int, default=3, help="maximum number of bisections of a coarse element"
+    )
+    parser.add_argument(
+        "--adapt-interval",
+        type=int,
+        default=20,
+        help="number of iterations between two mesh adaptations",
+    )
+    parser.add_argument(
+        "--adaptations", type=int, default=4, help="maximum number of mesh adaptations"
+    )
+    parser.add_argument(
+        "--interface",
+        type=float,
+        nargs=2,
+        default=[0.05, 0.95],
+        metavar=("LOW", "HIGH"),
+        help="elements with a density strictly between LOW and HIGH are refined",
+    )
+    parser.add_argument(
+        "--error-fraction",
+        type=float,
+        default=0.1,
+        help="elements with a squared stress error above this fraction of the largest one are "
+        "refined",
+    )
+    parser.add_argument(
+        "--filter-radius",
+        type=float,
+        default=1.5,
+        help="Helmholtz filter radius, in number of coarse elements",
+    )
+    add_solver_arguments(parser)
+    add_threading_arguments(parser)
+    add_output_arguments(parser)
+    add_profiling_arguments(parser)
+    return parser.parse_args()
+
+
+def run(args: argparse.Namespace) -> None:
+    profiler = Profiler.from_args(args)
+
+    size_x = 2.0
+    size_y = 1.0
+    nu = 0.3  # Poisson's ratio
+    material = {
+        "E": 1.0,  # Young's modulus of the solid material
+        "E_min": 1e-9,  # Young's modulus of the void material
+        "penalty": 3.0,
+        # Lamé parameters of a unit Young's modulus material
+        "lam": nu / ((1.0 + nu) * (1.0 - 2.0 * nu)),
+        "mu": 1.0 / (2.0 * (1.0 + nu)),
+        "force": -1.0 / size_y,
+    }
+    volume_fraction = 0.5
+    move = 0.2
+    max_iterations = 500
+    tolerance = 1e-2
+    # The filter radius is fixed in length, so it does not shrink with the refined elements
+    filter_radius = args.filter_radius * args.maxh
+
+    adaptive_mesh = AdaptiveMesh(
+        create_rectangle_geometry(size_x, size_y), maxh=args.maxh, levels=args.levels
+    )
+    with profiler.phase("mesh"):
+        mesh = adaptive_mesh.coarse_mesh()
+    with profiler.phase("setup"):
+        problem = CantileverProblem(mesh, args, material, filter_radius)
+    design = np.full(mesh.ne, volume_fraction)
+    adaptations = 0
+
+    for iteration in range(max_iterations):
+        adapt = (
+            iteration > 0
+            and iteration % args.adapt_interval == 0
+            and adaptations < args.adaptations
+        )
+        if adapt:
+            with profiler.phase("adapt"):
+                error = zz_error_indicator(problem.mesh, problem.solution_stress())
+                mesh = adaptive_mesh.adapt(
+                    problem.mesh,
+                    density=problem.rho.vec.FV().NumPy(),
+                    error=error,
+                    interface=args.interface,
+                    error_fraction=args.error_fraction,
+                )
+                design = transfer_element_values(design, problem.mesh, mesh)
+            with profiler.phase("setup"):
+                problem = CantileverProblem(mesh, args, material, filter_radius)
+            adaptations += 1
+            print(f"Adaptation {adaptations}: {mesh.ne} elements, {problem.fes.ndof} DOFs")
+
+        with profiler.phase("filter"):
+            density = problem.density_filter.apply(design)
+            problem.rho.vec.FV().NumPy()[:] = density
+        with profiler.phase("assemble"):
+            problem.a.Assemble()
+        with profiler.phase("factorize"):
+            problem.solver.update()
+        with profiler.phase("solve"):
+            problem.solver.solve(problem.f.vec, problem.gfu.vec)
+
+        with profiler.phase("sensitivity"):
+            ce = element_energy(
+                mesh,
+                lambda u, w: InnerProduct(
+                    stress(strain(u), mu=material["mu"], lam=material["lam"]), strain(w)
+                ),
+                problem.gfu,
+            )
+            objective = np.dot(problem.stiffness(density), ce)
+            dc = -problem.stiffness_derivative(density) * ce
+
+        dv = problem.dv
+        volume = np.dot(density, dv) / np.sum(dv)
+
+        with profiler.phase("update"):
+            # The Helmholtz filter conserves the volume, so the bisection can use the volume of
+            # the design itself instead of filtering every candidate
+            design_new = optimality_criteria_update(
+                design,
+                problem.density_filter.apply_transpose(dc),
+                dv,
+                volume_fraction,
+                move=move,
+            )
+            change = np.max(np.abs(design_new - design))
+            design = design_new
+
+        print(
+            f"It.: {iteration:4d}  Obj.: {objective:.6e}  Vol.: {volume:.3f}  ch.: {change:.3f}  "
+            f"ndof: {problem.fes.ndof}"
+        )
+        if args.profile:
+            print(profiler.summary(f"Iteration {iteration}:"))
+
+        # The design is only converged on the final mesh
+        if change < tolerance and adaptations >= args.adaptations:
+            break
+
+    problem.rho.vec.FV().NumPy()[:] = problem.density_filter.apply(design)
+    if args.output:
+        # The mesh changes between adaptations, so only the final design is written
+        writer = VTKWriter(mesh)
+        writer.write(
+            f"{args.output}.vtu",
+            point_data={"displacement": problem.gfu},
+            cell_data={"density": problem.rho},
+        )
+    if args.draw:
+        draw(problem.rho, mesh)
+
+    if args.trace:
+        profiler.write_trace(args.trace)
+
+
+def main() -> None:
+    args = parse_args()
+    run_in_task_manager(run, args)
+
+
+if __name__ == "__main__":
+    main()
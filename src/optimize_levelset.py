@@ -0,0 +1,219 @@
+import argparse
+
+import numpy as np
+from ngsolve import *
+
+from levelset import NarrowBandLevelSet, hole_level_set
+from mechanism import Springs, inverter_dofs
+from mesh import create_quad_mesh
+from optimize import strain, stress
+from output import VTKWriter, add_output_arguments, draw
+from profiling import Profiler, add_profiling_arguments
+from runtime import add_threading_arguments, run_in_task_manager
+from sensitivity import AdjointSolution, simp_stiffness
+from solver import LinearSolver, add_solver_arguments
+from structured import StructuredAssembler, cell_matrix
+
+
+def parse_args() -> argparse.Namespace:
+    parser = argparse.ArgumentParser(description="Level set topology optimization")
+    parser.add_argument(
+        "--problem",
+        choices=["cantilever", "mechanism"],
+        default="cantilever",
+        help="compliance minimization of a cantilever, or output displacement maximization of a "
+        "force inverter compliant mechanism",
+    )
+    parser.add_argument("--spring-in", type=float, default=0.1, help="input spring stiffness")
+    parser.add_argument("--spring-out", type=float, default=0.1, help="output spring stiffness")
+    parser.add_argument(
+        "--band", type=float, default=3.0, help="half width of the narrow band, in cells"
+    )
+    parser.add_argument(
+        "--steps",
+        type=int,
+        default=4,
+        help="Hamilton-Jacobi time steps per iteration, each moving the interface by 0.2 cells at "
+        "most",
+    )
+    parser.add_argument(
+        "--reinit-interval",
+        type=int,
+        default=5,
+        help="number of iterations between two reinitializations to a signed distance",
+    )
+    parser.add_argument(
+        "--volume-step",
+        type=float,
+        default=0.02,
+        help="decrease of the target volume fraction per iteration, until the final one is reached",
+    )
+    add_solver_arguments(parser)
+    add_threading_arguments(parser)
+    add_output_arguments(parser)
+    add_profiling_arguments(parser)
+    parser.add_argument(
+        "--output-interval",
+        type=int,
+        default=10,
+        help="number of iterations between two snapshots written to PREFIX_<iteration>.vtu",
+    )
+    args = parser.parse_args()
+    if args.condense:
+        parser.error("structured assembly does not support --condense")
+    if args.solver == "cg" and args.preconditioner != "local":
+        # The other preconditioners are built from the element matrices during Assemble
+        parser.error("structured assembly requires --preconditioner local with --solver cg")
+    return args
+
+
+def run(args: argparse.Namespace) -> None:
+    profiler = Profiler.from_args(args)
+
+    size_x = 2.0
+    size_y = 1.0
+    nx = 120
+    ny = 60
+    force = -1.0
+    force_in = 1.0
+    E = 1.0  # Young's modulus of the solid material
+    E_min = 1e-3 * E  # Young's modulus of the ersatz void material
+    nu = 0.3  # Poisson's ratio
+    volume_fraction = 0.5 if args.problem == "cantilever" else 0.3
+    max_iterations = 300
+    tolerance = 1e-3
+
+    with profiler.phase("mesh"):
+        mesh = create_quad_mesh(size_x=size_x, size_y=size_y, nx=nx, ny=ny)
+        mesh = Mesh(mesh)
+
+    # Lamé parameters of a unit Young's modulus material, scaled by the ersatz stiffness
+    lam = nu / ((1.0 + nu) * (1.0 - 2.0 * nu))
+    mu = 1.0 / (2.0 * (1.0 + nu))
+
+    if args.problem == "mechanism":
+        fes = VectorH1(mesh, order=1, dirichlety="bottom")
+        input_dof, output_dof, fixed_dofs = inverter_dofs(nx, ny)
+        freedofs = BitArray(fes.FreeDofs())
+        for dof in fixed_dofs:
+            freedofs.Clear(dof)
+    else:
+        fes = VectorH1(mesh, order=1, dirichlet="left")
+        freedofs = fes.FreeDofs()
+    u, v = fes.TnT()
+    gfu = GridFunction(fes)
+
+    # The matrix is only assembled by the form to allocate it, the values come from the
+    # structured assembler, with the element stiffness scaled by the material fraction
+    a = BilinearForm(InnerProduct(stress(strain(u), mu=mu, lam=lam), strain(v)) * dx)
+    solver = LinearSolver.from_args(a, freedofs, args)
+    a.Assemble()
+    element_matrix = cell_matrix(
+        size_x / nx,
+        size_y / ny,
+        lambda u, v: InnerProduct(stress(strain(u), mu=mu, lam=lam), strain(v)),
+    )
+    assembler = StructuredAssembler(a.mat, nx=nx, ny=ny, element_matrix=element_matrix)
+    cell_area = size_x / nx * size_y / ny
+
+    f = LinearForm(fes)
+    if args.problem == "mechanism":
+        f.Assemble()
+        f.vec[input_dof] = force_in
+        output = gfu.vec.CreateVector()
+        output[:] = 0.0
+        output[output_dof] = 1.0
+        adjoint = AdjointSolution(fes, solver, output)
+        springs = Springs(a.mat, [input_dof, output_dof], [args.spring_in, args.spring_out])
+    else:
+        f += CoefficientFunction((0, force / size_y)) * v * ds("right")
+        f.Assemble()
+
+    levelset = NarrowBandLevelSet(
+        hole_level_set(nx, ny, size_x, size_y, holes_x=6, holes_y=3, radius=0.1 * size_y),
+        size_x=size_x,
+        size_y=size_y,
+        band_cells=args.band,
+    )
+    target_volume = levelset.volume
+
+    if args.output:
+        writer = VTKWriter(mesh, asynchronous=True)
+
+    objectives = []
+    for iteration in range(max_iterations):
+        with profiler.phase("assemble"):
+            # Ersatz material: the stiffness of a cell is proportional to its material fraction
+            assembler.assemble(simp_stiffness(levelset.fraction, E=E, E_min=E_min, penalty=1.0))
+            if args.problem == "mechanism":
+                springs.add_to(a.mat)
+        with profiler.phase("factorize"):
+            solver.update()
+        with profiler.phase("solve"):
+            solver.solve(f.vec, gfu.vec)
+
+        with profiler.phase("sensitivity"):
+            # Shape derivative: the velocity grows the material where the mutual (or strain)
+            # energy density of the solid material is large, with w the adjoint solution
+            if args.problem == "mechanism":
+                with profiler.phase("adjoint"):
+                    adjoint.solve()
+                energy = assembler.element_energy(gfu.vec, adjoint.gf.vec)
+                objective = gfu.vec[output_dof]
+            else:
+                energy = assembler.element_energy(gfu.vec)
+                stiffness = simp_stiffness(levelset.fraction, E=E, E_min=E_min, penalty=1.0)
+                objective = np.dot(stiffness, energy)
+            velocity = E * energy / cell_area
+
+        volume = levelset.volume
+        with profiler.phase("update"):
+            target_volume = max(volume_fraction, target_volume - args.volume_step)
+            levelset.evolve(velocity, target_volume, steps=args.steps)
+            if (iteration + 1) % args.reinit_interval == 0:
+                levelset.reinitialize()
+
+        print(
+            f"It.: {iteration:4d}  Obj.: {objective:.6e}  Vol.: {volume:.3f}  "
+            f"band: {len(levelset.band)}"
+        )
+        if args.output and iteration % args.output_interval == 0:
+            with profiler.phase("output"):
+                writer.write(
+                    f"{args.output}_{iteration:04d}.vtu",
+                    point_data={"displacement": gfu, "level_set": levelset.phi},
+                    cell_data={"density": levelset.fraction},
+                )
+        if args.profile:
+            print(profiler.summary(f"Iteration {iteration}:"))
+
+        # Converged once the volume constraint is met and the objective has settled
+        objectives.append(objective)
+        if abs(volume - volume_fraction) < 1e-3 and len(objectives) > 5:
+            recent = np.array(objectives[-6:])
+            if np.max(np.abs(recent[:-1] - recent[-1])) < tolerance * abs(recent[-1]):
+                break
+
+    rho = GridFunction(L2(mesh, order=0))
+    rho.vec.FV().NumPy()[:] = levelset.fraction
+    if args.output:
+        writer.write(
+            f"{args.output}.vtu",
+            point_data={"displacement": gfu, "level_set": levelset.phi},
+            cell_data={"density": rho},
+        )
+        writer.close()
+    if args.draw:
+        draw(rho, mesh)
+
+    if args.trace:
+        profiler.write_trace(args.trace)
+
+
+def main() -> None:
+    args = parse_args()
+    run_in_task_manager(run, args)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,182 @@
+import argparse
+
+import numpy as np
+from mpi4py import MPI
+from ngsolve import *
+
+from filters import HelmholtzFilter
+from linear_elasticity_3d import create_beam_geometry
+from mesh import create_quad_mesh
+from optimize import optimality_criteria_update, strain, stress
+from output import VTKWriter, add_output_arguments
+from parallel import DistributedElements, distribute_mesh
+from profiling import Profiler, add_profiling_arguments
+from runtime import add_threading_arguments, run_in_task_manager
+from sensitivity import element_energy, simp_stiffness, simp_stiffness_derivative
+from solver import LinearSolver, add_solver_arguments
+
+
+def parse_args() -> argparse.Namespace:
+    parser = argparse.ArgumentParser(
+        description="SIMP topology optimization of a cantilever on a mesh distributed with MPI, "
+        "to be run with e.g. mpirun -np 4"
+    )
+    parser.add_argument(
+        "--dim",
+        type=int,
+        choices=[2, 3],
+        default=3,
+        help="2D quad grid (create_quad_mesh), or 3D tetrahedral mesh (GenerateMesh)",
+    )
+    parser.add_argument(
+        "--divisions", type=int, default=20, help="number of elements across the height"
+    )
+    parser.add_argument(
+        "--filter-radius",
+        type=float,
+        default=1.5,
+        help="Helmholtz filter radius, in number of elements",
+    )
+    add_solver_arguments(parser)
+    add_threading_arguments(parser)
+    add_output_arguments(parser)
+    add_profiling_arguments(parser)
+    # One thread per rank by default, the ranks already occupy the cores
+    parser.set_defaults(solver="cg", threads=1)
+    args = parser.parse_args()
+    if args.solver != "cg":
+        parser.error("the direct solvers are sequential, a distributed mesh requires --solver cg")
+    if args.preconditioner not in ["bddc", "local"]:
+        parser.error("a distributed mesh requires --preconditioner bddc or local")
+    if args.draw:
+        parser.error("--draw is not supported on a distributed mesh")
+    return args
+
+
+def run(args: argparse.Namespace) -> None:
+    comm = MPI.COMM_WORLD
+    profiler = Profiler.from_args(args)
+
+    size_x = 2.0
+    size_y = 1.0
+    size_z = 1.0
+    force = -1.0
+    E = 1.0  # Young's modulus of the solid material
+    E_min = 1e-9  # Young's modulus of the void material
+    nu = 0.3  # Poisson's ratio
+    penalty = 3.0
+    volume_fraction = 0.3 if args.dim == 3 else 0.5
+    move = 0.2
+    max_iterations = 300
+    tolerance = 1e-2
+    h = size_y / args.divisions
+
+    with profiler.phase("mesh"):
+        if args.dim == 2:
+            mesh = distribute_mesh(
+                comm,
+                lambda: create_quad_mesh(
+                    size_x=size_x, size_y=size_y, nx=2 * args.divisions, ny=args.divisions
+                ),
+            )
+            fixed, loaded = "left", "right"
+            traction = (0, force / size_y)
+        else:
+            geo = create_beam_geometry(length=size_x, height=size_y, width=size_z)
+            mesh = distribute_mesh(comm, lambda: geo.GenerateMesh(maxh=h))
+            fixed, loaded = "fix", "force"
+            traction = (0, force / (size_y * size_z), 0)
+
+    # Lamé parameters of a unit Young's modulus material
+    lam = nu / ((1.0 + nu) * (1.0 - 2.0 * nu))
+    mu = 1.0 / (2.0 * (1.0 + nu))
+
+    with profiler.phase("setup"):
+        fes = VectorH1(mesh, order=1, dirichlet=fixed)
+        u, v = fes.TnT()
+        gfu = GridFunction(fes)
+        # Element-wise, so each rank holds the densities of its own elements
+        rho = GridFunction(L2(mesh, order=0))
+        stiffness = simp_stiffness(rho, E=E, E_min=E_min, penalty=penalty)
+        a = BilinearForm(
+            InnerProduct(stress(strain(u), mu=stiffness * mu, lam=stiffness * lam), strain(v))
+            * dx,
+            condense=args.condense,
+        )
+        solver = LinearSolver.from_args(a, fes.FreeDofs(coupling=args.condense), args)
+        f = LinearForm(CoefficientFunction(traction) * v * ds(loaded)).Assemble()
+        density_filter = HelmholtzFilter(mesh, radius=args.filter_radius * h, inverse="cg")
+        elements = DistributedElements(
+            comm, np.array(Integrate(CoefficientFunction(1.0), mesh, element_wise=True))
+        )
+    dv = elements.volumes
+    if comm.rank == 0:
+        print(f"Ranks: {comm.size}, elements: {elements.num_elements}, DOFs: {fes.ndofglobal}")
+
+    design = np.full(mesh.ne, volume_fraction)
+    for iteration in range(max_iterations):
+        with profiler.phase("filter"):
+            density = density_filter.apply(design)
+            rho.vec.FV().NumPy()[:] = density
+        with profiler.phase("assemble"):
+            a.Assemble()
+        with profiler.phase("factorize"):
+            solver.update()
+        with profiler.phase("solve"):
+            solver.solve(f.vec, gfu.vec)
+
+        with profiler.phase("sensitivity"):
+            ce = element_energy(
+                mesh, lambda u, w: InnerProduct(stress(strain(u), mu=mu, lam=lam), strain(w)), gfu
+            )
+            objective = elements.dot(simp_stiffness(density, E=E, E_min=E_min, penalty=penalty), ce)
+            dc = -simp_stiffness_derivative(density, E=E, E_min=E_min, penalty=penalty) * ce
+
+        volume = elements.volume_fraction(density)
+
+        with profiler.phase("update"):
+            # The filter conserves the volume, so the volume of the design is that of the
+            # filtered density, and each step of the bisection is a single scalar allreduce. It
+            # takes the same steps on all the ranks, each one updating its own elements.
+            design_new = optimality_criteria_update(
+                design,
+                density_filter.apply_transpose(dc),
+                dv,
+                volume_fraction,
+                move=move,
+                volume=elements.volume_fraction,
+            )
+            change = elements.max(np.abs(design_new - design))
+            design = design_new
+
+        if comm.rank == 0:
+            print(
+                f"It.: {iteration:4d}  Obj.: {objective:.6e}  Vol.: {volume:.3f}  "
+                f"ch.: {change:.3f}  cg it.: {solver.iterations}"
+            )
+            if args.profile:
+                print(profiler.summary(f"Iteration {iteration}:"))
+
+        if change < tolerance:
+            break
+
+    rho.vec.FV().NumPy()[:] = density_filter.apply(design)
+    if args.output and mesh.ne > 0:
+        # One piece per rank, of the elements it holds
+        VTKWriter(mesh).write(
+            f"{args.output}_{comm.rank}.vtu",
+            point_data={"displacement": gfu},
+            cell_data={"density": rho},
+        )
+
+    if args.trace:
+        profiler.write_trace(f"{args.trace}.{comm.rank}")
+
+
+def main() -> None:
+    args = parse_args()
+    run_in_task_manager(run, args)
+
+
+if __name__ == "__main__":
+    main()
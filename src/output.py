@@ -0,0 +1,142 @@
+import argparse
+import concurrent.futures
+import os.path
+
+import numpy as np
+from ngsolve import *
+
+from probe import vertex_coordinates, vertex_values
+
+# VTK cell types, indexed by (dimension, number of vertices)
+VTK_CELL_TYPES = {(2, 3): 5, (2, 4): 9, (3, 4): 10, (3, 8): 12, (3, 6): 13, (3, 5): 14}
+
+
+def add_output_arguments(parser: argparse.ArgumentParser) -> None:
+    parser.add_argument(
+        "--output",
+        metavar="PREFIX",
+        help="write the solution to PREFIX.vtu (binary VTK XML), nothing is written by default",
+    )
+    parser.add_argument(
+        "--draw",
+        action="store_true",
+        help="draw the solution to out.html with the NGSolve web GUI and open it in a browser",
+    )
+
+
+def draw(cf, mesh: Mesh, filename: str = "out.html") -> None:
+    """Opt-in interactive visualization, kept out of the import path of headless runs"""
+    import webbrowser
+
+    from ngsolve.webgui import Draw
+
+    Draw(cf, mesh, filename=filename)
+    webbrowser.open("file://" + os.path.abspath(filename))
+
+
+class VTKWriter:
+    """Writer of VTK XML unstructured grid files with raw binary appended data.
+
+    The mesh arrays are extracted once. Data arrays are copied when write() is called, and with
+    asynchronous=True the file itself is written by a background thread, so that the caller (e.g.
+    an optimization loop) can keep modifying its vectors without waiting for the I/O. At most
+    max_pending writes are queued, after which write() blocks on the oldest one.
+    """
+
+    def __init__(self, mesh: Mesh, asynchronous: bool = False, max_pending: int = 2):
+        points = vertex_coordinates(mesh)
+        self.points = np.zeros((points.shape[0], 3))
+        self.points[:, : points.shape[1]] = points
+        connectivity = []
+        offsets = []
+        types = []
+        for el in mesh.Elements(VOL):
+            vertices = [v.nr for v in el.vertices]
+            connectivity.extend(vertices)
+            offsets.append(len(connectivity))
+            types.append(VTK_CELL_TYPES[(mesh.dim, len(vertices))])
+        self.connectivity = np.array(connectivity, dtype=np.int64)
+        self.offsets = np.array(offsets, dtype=np.int64)
+        self.types = np.array(types, dtype=np.uint8)
+
+        self.executor = None
+        if asynchronous:
+            self.executor = concurrent.futures.ThreadPoolExecutor(max_workers=1)
+        self.max_pending = max_pending
+        self.pending = []
+
+    def write(self, filename: str, point_data: dict = None, cell_data: dict = None) -> None:
+        """Writes point (vertex) and cell (element) data, given as GridFunctions or arrays"""
+        point_data = {
+            name: vertex_values(value) if isinstance(value, GridFunction) else np.array(value)
+            for name, value in (point_data or {}).items()
+        }
+        # Cell data GridFunctions are piecewise constant, their DOFs are the element values
+        cell_data = {
+            name: np.array(value.vec.FV().NumPy() if isinstance(value, GridFunction) else value)
+            for name, value in (cell_data or {}).items()
+        }
+        if self.executor is None:
+            self._write(filename, point_data, cell_data)
+            return
+        while len(self.pending) >= self.max_pending:
+            self.pending.pop(0).result()
+        self.pending.append(self.executor.submit(self._write, filename, point_data, cell_data))
+
+    def close(self) -> None:
+        """Waits for the pending writes, and raises their exceptions if any"""
+        for future in self.pending:
+            future.result()
+        self.pending = []
+        if self.executor is not None:
+            self.executor.shutdown()
+
+    def _write(self, filename: str, point_data: dict, cell_data: dict) -> None:
+        arrays = []
+        offset = 0
+
+        def data_array(name: str, values: np.ndarray, vtk_type: str) -> str:
+            nonlocal offset
+            values = np.ascontiguousarray(values)
+            # 2D vectors are padded to 3 components, which is what VTK readers expect
+            if values.ndim == 2 and values.shape[1] == 2:
+                values = np.hstack([values, np.zeros((values.shape[0], 1))])
+            components = values.shape[1] if values.ndim == 2 else 1
+            arrays.append(values)
+            header = (
+                f'<DataArray type="{vtk_type}" Name="{name}" NumberOfComponents="{components}" '
+                f'format="appended" offset="{offset}"/>'
+            )
+            offset += 8 + values.nbytes
+            return header
+
+        xml = [
+            '<?xml version="1.0"?>',
+            '<VTKFile type="UnstructuredGrid" version="1.0" byte_order="LittleEndian" '
+            'header_type="UInt64">',
+            "<UnstructuredGrid>",
+            f'<Piece NumberOfPoints="{len(self.points)}" NumberOfCells="{len(self.types)}">',
+            "<Points>",
+            data_array("points", self.points, "Float64"),
+            "</Points>",
+            "<Cells>",
+            data_array("connectivity", self.connectivity, "Int64"),
+            data_array("offsets", self.offsets, "Int64"),
+            data_array("types", self.types, "UInt8"),
+            "</Cells>",
+            "<PointData>",
+            *[data_array(name, values, "Float64") for name, values in point_data.items()],
+            "</PointData>",
+            "<CellData>",
+            *[data_array(name, values, "Float64") for name, values in cell_data.items()],
+            "</CellData>",
+            "</Piece>",
+            "</UnstructuredGrid>",
+            '<AppendedData encoding="raw">',
+        ]
+        with open(filename, "wb") as file:
+            file.write("\n".join(xml).encode() + b"\n_")
+            for values in arrays:
+                file.write(np.uint64(values.nbytes).tobytes())
+                file.write(values.tobytes())
+            file.write(b"\n</AppendedData>\n</VTKFile>\n")
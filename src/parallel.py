@@ -0,0 +1,51 @@
+import numpy as np
+from mpi4py import MPI
+from netgen.meshing import Mesh as NetgenMesh
+from ngsolve import *
+
+
+def distribute_mesh(comm: MPI.Comm, create) -> Mesh:
+    """Mesh created by create() on rank 0 and partitioned across the ranks of comm.
+
+    create() returns a Netgen mesh, e.g. from GenerateMesh or create_quad_mesh, and is only called
+    on rank 0. Netgen partitions it with METIS and sends each rank its elements, with the
+    interface vertices, edges and faces shared between neighbouring ranks. The spaces, forms and
+    vectors built on the returned mesh are then distributed as well: assembly is local to each
+    rank, and matrix-vector products and inner products communicate over the interfaces.
+    """
+    if comm.rank == 0:
+        ngmesh = create().Distribute(comm)
+    else:
+        ngmesh = NetgenMesh.Receive(comm)
+    return Mesh(ngmesh)
+
+
+class DistributedElements:
+    """Reductions of element-wise arrays over a distributed mesh.
+
+    Each rank holds the values of its own elements (e.g. from Integrate(element_wise=True) or an
+    L2 order 0 GridFunction), and every element belongs to exactly one rank, so a global sum is the
+    allreduce of the local sums. Every rank gets the same result, which keeps the control flow of
+    an optimization loop (convergence tests, OC bisection) identical on all the ranks. Rank 0 may
+    hold no elements at all, all the reductions accept empty arrays.
+    """
+
+    def __init__(self, comm: MPI.Comm, volumes: np.ndarray):
+        self.comm = comm
+        self.volumes = volumes
+        self.total_volume = self.sum(volumes)
+        self.num_elements = comm.allreduce(len(volumes), op=MPI.SUM)
+
+    def sum(self, values: np.ndarray) -> float:
+        return self.comm.allreduce(float(np.sum(values)), op=MPI.SUM)
+
+    def dot(self, a: np.ndarray, b: np.ndarray) -> float:
+        return self.comm.allreduce(float(np.dot(a, b)), op=MPI.SUM)
+
+    def max(self, values: np.ndarray) -> float:
+        return self.comm.allreduce(float(np.max(values, initial=-np.inf)), op=MPI.MAX)
+
+    def volume_fraction(self, density: np.ndarray) -> float:
+        """Global volume fraction, usable as the volume of optimality_criteria_update, in which
+        case every step of the bisection is one allreduce"""
+        return self.dot(density, self.volumes) / self.total_volume
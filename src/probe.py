@@ -0,0 +1,46 @@
+import numpy as np
+from ngsolve import *
+
+
+def vertex_coordinates(mesh: Mesh) -> np.ndarray:
+    """Coordinates of the mesh vertices as a (nv, dim) array, without a loop over the vertices"""
+    return np.array(mesh.ngmesh.Coordinates(), dtype=np.float64)
+
+
+def vertex_values(gf: GridFunction, vertices: np.ndarray = None) -> np.ndarray:
+    """Values of an H1 or VectorH1 GridFunction at the mesh vertices, one row per vertex.
+
+    The low order DOFs of each (scalar) H1 component are the vertex values, numbered like the
+    vertices, so this is a slice of the coefficient vector and not a point evaluation. vertices
+    optionally selects a subset of the vertices.
+    """
+    if vertices is None:
+        vertices = slice(0, gf.space.mesh.nv)
+    if len(gf.components) == 0:
+        return gf.vec.FV().NumPy()[vertices].copy()
+    return np.stack([c.vec.FV().NumPy()[vertices] for c in gf.components], axis=1)
+
+
+def region_vertices(mesh: Mesh, name: str, vb: VorB = BND) -> np.ndarray:
+    """Sorted vertex numbers of the elements of the region called name"""
+    vertices = {v.nr for el in mesh.Elements(vb) if el.mat == name for v in el.vertices}
+    return np.array(sorted(vertices), dtype=np.int64)
+
+
+class RegionProbe:
+    """Evaluation of fields at the vertices of a mesh region, e.g. a loaded boundary.
+
+    The vertices and their locations in the mesh (element and local coordinates) are found once,
+    so each evaluation is cheap: H1 and VectorH1 GridFunctions are read directly from their vertex
+    DOFs, and other CoefficientFunctions are evaluated at the precomputed mesh points.
+    """
+
+    def __init__(self, mesh: Mesh, name: str, vb: VorB = BND):
+        self.vertices = region_vertices(mesh, name, vb)
+        self.points = vertex_coordinates(mesh)[self.vertices]
+        self.mesh_points = mesh(*self.points.T)
+
+    def __call__(self, cf: CoefficientFunction) -> np.ndarray:
+        if isinstance(cf, GridFunction) and isinstance(cf.space, (H1, VectorH1)):
+            return vertex_values(cf, self.vertices)
+        return cf(self.mesh_points)
@@ -0,0 +1,126 @@
+import argparse
+import contextlib
+import json
+import os
+import resource
+import threading
+import time
+import tracemalloc
+
+
+def add_profiling_arguments(parser: argparse.ArgumentParser) -> None:
+    parser.add_argument(
+        "--profile",
+        action="store_true",
+        help="print per-phase wall time, CPU time and memory summaries",
+    )
+    parser.add_argument(
+        "--trace",
+        metavar="FILE",
+        help="write the phases as a Chrome trace (JSON) to FILE, viewable in about:tracing",
+    )
+    parser.add_argument(
+        "--trace-allocations",
+        action="store_true",
+        help="also record the Python allocations of each phase (slower)",
+    )
+
+
+class Profiler:
+    """Lightweight instrumentation of the phases of a run.
+
+    Each phase records its wall time, CPU time (of the whole process, so it exceeds the wall
+    time when NGSolve runs multithreaded), the peak resident set size of the process so far and,
+    with trace_allocations, the net and peak Python allocations measured by tracemalloc (NumPy
+    arrays included, memory allocated by NGSolve itself is only visible in the RSS).
+
+    When disabled, phase() returns a no-op context, so the instrumentation can stay in the code.
+    """
+
+    def __init__(self, enabled: bool = True, trace_allocations: bool = False):
+        self.enabled = enabled
+        self.trace_allocations = enabled and trace_allocations
+        self.events = []
+        self.summary_start = 0
+        self.origin = time.perf_counter()
+        if self.trace_allocations:
+            tracemalloc.start()
+
+    @classmethod
+    def from_args(cls, args: argparse.Namespace):
+        return cls(
+            enabled=args.profile or args.trace is not None,
+            trace_allocations=args.trace_allocations,
+        )
+
+    def phase(self, name: str, **info):
+        if not self.enabled:
+            return contextlib.nullcontext()
+        return self._phase(name, info)
+
+    @contextlib.contextmanager
+    def _phase(self, name: str, info: dict):
+        if self.trace_allocations:
+            allocated_start = tracemalloc.get_traced_memory()[0]
+            tracemalloc.reset_peak()
+        cpu_start = time.process_time()
+        wall_start = time.perf_counter()
+        try:
+            yield
+        finally:
+            event = {
+                "name": name,
+                "start": wall_start - self.origin,
+                "wall_time": time.perf_counter() - wall_start,
+                "cpu_time": time.process_time() - cpu_start,
+                # ru_maxrss is in kilobytes on Linux
+                "peak_rss_mb": resource.getrusage(resource.RUSAGE_SELF).ru_maxrss / 1024.0,
+                "thread": threading.get_ident(),
+                **info,
+            }
+            if self.trace_allocations:
+                allocated, peak = tracemalloc.get_traced_memory()
+                event["allocated_mb"] = (allocated - allocated_start) / 2**20
+                event["peak_allocated_mb"] = (peak - allocated_start) / 2**20
+            self.events.append(event)
+
+    def summary(self, title: str = "") -> str:
+        """Summary of the phases recorded since the previous summary, aggregated by name"""
+        totals = {}
+        for event in self.events[self.summary_start :]:
+            total = totals.setdefault(
+                event["name"], {"count": 0, "wall_time": 0.0, "cpu_time": 0.0}
+            )
+            total["count"] += 1
+            total["wall_time"] += event["wall_time"]
+            total["cpu_time"] += event["cpu_time"]
+        self.summary_start = len(self.events)
+        peak_rss = self.events[-1]["peak_rss_mb"] if self.events else 0.0
+        lines = [f"{title}  peak RSS {peak_rss:.1f} MB"]
+        for name, total in totals.items():
+            lines.append(
+                f"  {name:<16} {total['count']:>5}x  wall {total['wall_time']:.4f} s  "
+                f"cpu {total['cpu_time']:.4f} s"
+            )
+        return "\n".join(lines)
+
+    def write_trace(self, filename: str) -> None:
+        """Writes the phases as complete events of the Chrome trace event format"""
+        trace_events = [
+            {
+                "name": event["name"],
+                "ph": "X",
+                "ts": event["start"] * 1e6,
+                "dur": event["wall_time"] * 1e6,
+                "pid": os.getpid(),
+                "tid": event["thread"],
+                "args": {
+                    key: value
+                    for key, value in event.items()
+                    if key not in ("name", "start", "wall_time", "thread")
+                },
+            }
+            for event in self.events
+        ]
+        with open(filename, "w") as file:
+            json.dump({"traceEvents": trace_events, "displayTimeUnit": "ms"}, file)
@@ -0,0 +1,21 @@
+import argparse
+import os
+
+from ngsolve import *
+
+
+def add_threading_arguments(parser: argparse.ArgumentParser) -> None:
+    parser.add_argument(
+        "--threads",
+        type=int,
+        default=os.cpu_count(),
+        help="number of threads of the NGSolve TaskManager, used by assembly, factorization, "
+        "solvers and integration",
+    )
+
+
+def run_in_task_manager(run, args: argparse.Namespace) -> None:
+    """Runs run(args) inside an NGSolve TaskManager with args.threads threads"""
+    SetNumThreads(args.threads)
+    with TaskManager():
+        run(args)
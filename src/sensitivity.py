@@ -0,0 +1,52 @@
+import numpy as np
+from ngsolve import *
+
+
+def simp_stiffness(density, E: float, E_min: float, penalty: float):
+    """Modified SIMP interpolation of the Young's modulus, E_min + density^p (E - E_min)"""
+    return E_min + density**penalty * (E - E_min)
+
+
+def simp_stiffness_derivative(density, E: float, E_min: float, penalty: float):
+    return penalty * density ** (penalty - 1.0) * (E - E_min)
+
+
+def element_integrals(mesh: Mesh, cf: CoefficientFunction) -> np.ndarray:
+    """Integral of cf over every element, as a NumPy array ordered like the mesh elements"""
+    return np.array(Integrate(cf, mesh, VOL, element_wise=True))
+
+
+def element_energy(
+    mesh: Mesh, energy_density, u: GridFunction, w: GridFunction = None
+) -> np.ndarray:
+    """Element-wise mutual energy integral of energy_density(u, w) over each element.
+
+    energy_density(u, w) is typically InnerProduct(stress(strain(u)), strain(w)) for a unit Young's
+    modulus. With w = u (the default), this is the element strain energy u_e^T K_e u_e, otherwise
+    the mutual energy w_e^T K_e u_e needed by adjoint sensitivities. All the elements are integrated
+    in a single vectorized pass.
+    """
+    return element_integrals(mesh, energy_density(u, u if w is None else w))
+
+
+class AdjointSolution:
+    """Adjoint state of a linear output J(u) = l^T u of a symmetric problem K(rho) u = f.
+
+    The adjoint problem K(rho) w = l shares the matrix of the primal one, so it is solved with the
+    same (already updated) solver, e.g. the same factorization. The sensitivity of J is then
+    dJ/drho_e = -dE/drho_e w_e^T K0_e u_e, with K0_e the element matrix for a unit Young's
+    modulus. For the compliance J = f^T u, w = u and no adjoint solve is needed.
+    """
+
+    def __init__(self, fes: FESpace, solver, output: BaseVector):
+        self.solver = solver
+        self.output = output
+        self.gf = GridFunction(fes)
+
+    def solve(self) -> GridFunction:
+        self.solver.solve(self.output, self.gf.vec)
+        return self.gf
+
+    def sensitivity(self, stiffness_derivative: np.ndarray, mutual_energy: np.ndarray):
+        """Sensitivity of l^T u, from the element-wise mutual energies w_e^T K0_e u_e"""
+        return -stiffness_derivative * mutual_energy
@@ -0,0 +1,179 @@
+import argparse
+
+from ngsolve import *
+from ngsolve.krylovspace import CGSolver
+
+DIRECT_SOLVERS = ["sparsecholesky", "pardiso", "umfpack"]
+ITERATIVE_SOLVERS = ["cg"]
+PRECONDITIONERS = ["bddc", "multigrid", "h1amg", "local"]
+# Preconditioners built by the caller from the structure of the grid, passed as pre
+GRID_PRECONDITIONERS = ["gmg"]
+
+
+def add_solver_arguments(parser: argparse.ArgumentParser, grid: bool = False) -> None:
+    """Solver options, grid=True also offers the preconditioners of structured grids"""
+    parser.add_argument(
+        "--solver",
+        choices=DIRECT_SOLVERS + ITERATIVE_SOLVERS,
+        default="sparsecholesky",
+        help="sparse direct factorization, or preconditioned conjugate gradient (cg)",
+    )
+    parser.add_argument(
+        "--preconditioner",
+        choices=PRECONDITIONERS + (GRID_PRECONDITIONERS if grid else []),
+        default="bddc",
+        help="preconditioner of the cg solver",
+    )
+    parser.add_argument("--tol", type=float, default=1e-10, help="relative tolerance of cg")
+    parser.add_argument("--maxiter", type=int, default=10000, help="iteration limit of cg")
+    parser.add_argument(
+        "--condense",
+        action="store_true",
+        help="static condensation of the element interior DOFs, only the coupling DOFs enter the "
+        "global system",
+    )
+
+
+class LinearSolver:
+    """Solver for the linear system of a BilinearForm, selectable per run.
+
+    Must be created before the form is assembled, since the cg preconditioners (except local,
+    which only needs the assembled matrix) register with the BilinearForm and are built during
+    assembly. update() must be called after every assembly.
+
+    Direct factorizations are computed on the first update() and then only numerically refactored,
+    which assumes that the matrix is reassembled in place with an unchanged sparsity pattern.
+
+    The cg solver starts from the current value of the solution vector, so reusing the same vector
+    across optimization iterations warm starts it with the previous displacement. Its memory usage
+    is bounded by the matrix and preconditioner, without the fill-in of a direct factorization.
+
+    A preconditioner built outside (e.g. a GeometricMultigrid, which the caller updates before
+    update()) can be passed as pre, instead of registering one with the BilinearForm.
+
+    With condense=True, the BilinearForm must have been created with condense=True and freedofs
+    must only contain coupling DOFs (FreeDofs(coupling=True)). The global matrix is then the Schur
+    complement on the coupling DOFs, and the interior DOFs are recovered from the harmonic extension
+    and the element-local inner solves.
+    """
+
+    def __init__(
+        self,
+        a: BilinearForm,
+        freedofs: BitArray,
+        solver: str = "sparsecholesky",
+        preconditioner: str = "bddc",
+        tol: float = 1e-10,
+        maxiter: int = 10000,
+        condense: bool = False,
+        pre: BaseMatrix = None,
+    ):
+        self.a = a
+        self.freedofs = freedofs
+        self.solver = solver
+        self.preconditioner = preconditioner
+        self.tol = tol
+        self.maxiter = maxiter
+        self.condense = condense
+        self.pre = pre
+        # Preconditioners (registered with the form or passed as pre) are built on the free DOFs
+        # of the space, and must be projected when others are fixed too, e.g. single supports
+        self.masked = not self._same_dofs(freedofs, a.space.FreeDofs(coupling=condense))
+        if pre is None and solver in ITERATIVE_SOLVERS:
+            if preconditioner in GRID_PRECONDITIONERS:
+                raise ValueError(f"the {preconditioner} preconditioner must be passed as pre")
+            if preconditioner != "local":
+                self.pre = Preconditioner(a, preconditioner)
+        self.inv = None
+
+    @classmethod
+    def from_args(
+        cls, a: BilinearForm, freedofs: BitArray, args: argparse.Namespace, pre: BaseMatrix = None
+    ):
+        return cls(
+            a,
+            freedofs,
+            solver=args.solver,
+            preconditioner=args.preconditioner,
+            tol=args.tol,
+            maxiter=args.maxiter,
+            condense=args.condense,
+            pre=pre,
+        )
+
+    @staticmethod
+    def _same_dofs(a: BitArray, b: BitArray) -> bool:
+        return (a & b).NumSet() == a.NumSet() == b.NumSet()
+
+    @property
+    def iterative(self) -> bool:
+        return self.solver in ITERATIVE_SOLVERS
+
+    @property
+    def iterations(self) -> int:
+        """Number of iterations of the last solve, 1 for direct solvers"""
+        return self.inv.iterations if self.iterative else 1
+
+    def set_freedofs(self, freedofs: BitArray) -> None:
+        """Changes the DOFs solved for, e.g. to drop DOFs of void elements from the system.
+
+        The sparsity pattern of the factorized system changes with them, so the next update()
+        of a direct solver factorizes from scratch instead of refactoring in place. The cg
+        preconditioner is restricted to them by projection.
+        """
+        self.freedofs = freedofs
+        self.masked = True
+        if not self.iterative:
+            self.inv = None
+
+    def update(self) -> None:
+        if self.iterative:
+            pre = self.pre
+            if pre is None:
+                pre = self.a.mat.CreateSmoother(self.freedofs)
+            elif self.masked:
+                projector = Projector(self.freedofs, True)
+                pre = projector @ pre @ projector
+            # CGSolver takes either a preconditioner or free DOFs, the preconditioner already
+            # restricts the iteration to the free DOFs
+            self.inv = CGSolver(self.a.mat, pre=pre, tol=self.tol, maxiter=self.maxiter)
+        elif self.inv is None:
+            self.inv = self.a.mat.Inverse(freedofs=self.freedofs, inverse=self.solver)
+        else:
+            # Only the matrix values changed since the last factorization, the sparsity pattern
+            # is that of the space. Update() refactors the same matrix object in place, keeping
+            # the fill-reducing ordering and symbolic factorization (for sparsecholesky).
+            self.inv.Update()
+
+    def solve(self, rhs: BaseVector, sol: BaseVector) -> None:
+        if not self.condense:
+            self._solve(rhs, sol)
+            return
+        # Condensed right-hand side, coupling DOFs solve, then the interior DOFs
+        condensed_rhs = rhs.CreateVector()
+        condensed_rhs.data = rhs + self.a.harmonic_extension_trans * rhs
+        self._solve(condensed_rhs, sol)
+        coupling = sol.CreateVector()
+        coupling.data = Projector(self.freedofs, True) * sol
+        sol.data = coupling + self.a.harmonic_extension * coupling
+        sol.data += self.a.inner_solve * rhs
+
+    def _solve(self, rhs: BaseVector, sol: BaseVector) -> None:
+        if self.iterative:
+            self.inv.Solve(rhs=rhs, sol=sol, initialize=False)
+        else:
+            sol.data = self.inv * rhs
+
+    def solve_multiple(self, rhs: MultiVector, sol: MultiVector) -> None:
+        """Solves for several right-hand sides, e.g. load cases, with the same matrix.
+
+        Direct inverses are applied to the whole MultiVector at once, which lets the factorization
+        process all the right-hand sides in a blocked triangular solve instead of one at a time.
+        Krylov iterations are inherently per right-hand side and loop over the columns, as well as
+        the condensed solves.
+        """
+        if self.iterative or self.condense:
+            for i in range(len(rhs)):
+                self.solve(rhs[i], sol[i])
+        else:
+            sol[:] = self.inv * rhs
@@ -0,0 +1,100 @@
+import numpy as np
+from ngsolve import *
+
+from mesh import create_quad_mesh
+
+
+def quad_element_dofs(nx: int, ny: int) -> np.ndarray:
+    """DOFs of each element of an order 1 VectorH1 space on a create_quad_mesh grid.
+
+    Vertex DOFs are numbered like the mesh points, and the components are blocked, i.e. the x
+    component of all vertices comes first. Local DOFs are ordered like the DOFs of a single cell
+    mesh, which is what cell_matrix() assembles.
+    """
+    num_points = (nx + 1) * (ny + 1)
+    ix, iy = np.meshgrid(np.arange(nx), np.arange(ny))
+    p0 = (iy * (nx + 1) + ix).ravel()
+    vertices = np.stack([p0, p0 + 1, p0 + nx + 1, p0 + nx + 2], axis=1)
+    return np.concatenate([vertices, vertices + num_points], axis=1)
+
+
+def dilate_cells(cells: np.ndarray, nx: int, ny: int, faces_only: bool = False) -> np.ndarray:
+    """Cells of the boolean mask cells, ordered like the elements of create_quad_mesh, together
+    with the cells sharing a vertex (or with faces_only, a face) with them"""
+    grid = np.pad(cells.reshape(ny, nx), 1)
+    dilated = np.zeros((ny, nx), dtype=bool)
+    for di in range(3):
+        for dj in range(3):
+            if not faces_only or di == 1 or dj == 1:
+                dilated |= grid[di : di + ny, dj : dj + nx]
+    return dilated.ravel()
+
+
+def anchored_cells(cells: np.ndarray, anchors: np.ndarray, nx: int, ny: int) -> np.ndarray:
+    """Cells of the mask cells connected to a cell of the mask anchors (e.g. the supported cells)
+    through a chain of cells of the mask sharing faces.
+
+    Cells only connected through a vertex would form a hinge, so connected components of
+    elasticity are face-connected. Any other cell is part of a floating component, whose stiffness
+    matrix is singular. The components are grown from the anchors one layer of cells at a time.
+    """
+    reached = cells & anchors
+    while True:
+        grown = dilate_cells(reached, nx, ny, faces_only=True) & cells
+        if np.array_equal(grown, reached):
+            return reached
+        reached = grown
+
+
+def cell_matrix(size_x: float, size_y: float, integrand) -> np.ndarray:
+    """Dense element matrix of integrand(u, v) * dx on a single size_x by size_y quad cell"""
+    cell = Mesh(create_quad_mesh(size_x=size_x, size_y=size_y, nx=1, ny=1))
+    fes = VectorH1(cell, order=1)
+    u, v = fes.TnT()
+    a = BilinearForm(integrand(u, v) * dx).Assemble()
+    return np.array(a.mat.ToDense().NumPy())
+
+
+def csr_positions(mat, element_dofs: np.ndarray) -> np.ndarray:
+    """Positions in the CSR values of mat of every entry of every element matrix, flattened.
+
+    element_dofs has one row of DOFs per element (or patch of elements), all of whose couplings
+    must be in the sparsity pattern of mat.
+    """
+    _, cols, rowptr = mat.CSR()
+    rows = np.repeat(np.arange(len(rowptr) - 1), np.diff(rowptr))
+    csr_keys = rows.astype(np.int64) * mat.width + cols
+    ndofs = element_dofs.shape[1]
+    coo_rows = np.repeat(element_dofs, ndofs, axis=1).astype(np.int64)
+    coo_cols = np.tile(element_dofs, (1, ndofs))
+    return np.searchsorted(csr_keys, (coo_rows * mat.width + coo_cols).ravel())
+
+
+class StructuredAssembler:
+    """Assembly of an order 1 VectorH1 stiffness matrix on a regular create_quad_mesh grid.
+
+    All cells are identical, so the element matrix is computed once and each element contribution
+    is that matrix scaled by a per-element factor (e.g. the SIMP stiffness). The values are
+    scattered directly into the storage of an already allocated sparse matrix (e.g. the matrix of
+    a BilinearForm on the same space, assembled once), so that its sparsity pattern and any solver
+    built on top of it are preserved.
+    """
+
+    def __init__(self, mat, nx: int, ny: int, element_matrix: np.ndarray):
+        self.mat = mat
+        self.element_matrix = element_matrix
+        self.element_dofs = quad_element_dofs(nx, ny)
+        self.positions = csr_positions(mat, self.element_dofs)
+        self.values = mat.AsVector().FV().NumPy()
+
+    def assemble(self, element_scale: np.ndarray) -> None:
+        """Overwrites the matrix with the sum of the element matrices scaled by element_scale"""
+        weights = np.outer(element_scale, self.element_matrix.ravel()).ravel()
+        self.values[:] = np.bincount(self.positions, weights=weights, minlength=len(self.values))
+
+    def element_energy(self, vec, other=None) -> np.ndarray:
+        """Unscaled element energies u_e^T K_e u_e of the vector vec, or mutual energies
+        w_e^T K_e u_e with the vector other"""
+        ue = vec.FV().NumPy()[self.element_dofs]
+        we = ue if other is None else other.FV().NumPy()[self.element_dofs]
+        return np.einsum("ei,ij,ej->e", we, self.element_matrix, ue)